@@ -0,0 +1,652 @@
+
+#include <string.h>
+#include "epaper.h"
+#include "dlist.h"
+#include "bitops.h"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+static ALWAYS_INLINE uint32_t rop_apply(rop_t rop, uint32_t d, uint32_t s)
+{
+    switch(rop)
+    {
+        case ROP_COPY:   return s;
+        case ROP_OR:     return d | s;
+        case ROP_AND:    return d & s;
+        case ROP_XOR:    return d ^ s;
+        case ROP_ANDNOT: return d & ~s;
+        case ROP_INVERT: return ~s;
+    }
+    return d;
+}
+
+static ALWAYS_INLINE void rop_byte(rop_t rop, uint8_t* d, uint8_t s, uint8_t mask)
+{
+    *d = (*d & ~mask) | (rop_apply(rop, *d, s) & mask);
+}
+
+/*
+ * Source byte lookup for the head and tail of a row. Bytes outside of the
+ * source row are never touched, they read as zero and end up masked off.
+ */
+static ALWAYS_INLINE uint8_t fetch_byte(const uint8_t* s, int i, int last, int r)
+{
+    uint8_t hi = (i >= 0 && i <= last)? s[i] : 0;
+    if (r == 0)
+    {
+        return hi;
+    }
+    uint8_t lo = (i + 1 >= 0 && i + 1 <= last)? s[i + 1] : 0;
+    return (hi << r) | (lo >> (8 - r));
+}
+
+/*
+ * Combines w bits starting at bit sbit of the source row s into the
+ * destination row d starting at bit dbit. Destination byte i takes its bits
+ * from source bytes i + off and i + off + 1 shifted left by r, so the body
+ * of the row runs as a 32 bit funnel shift and only the partial head and
+ * tail bytes are masked.
+ */
+static ALWAYS_INLINE void blit_row(uint8_t* d, int dbit, const uint8_t* s, int sbit, int w, rop_t rop)
+{
+    d += dbit >> 3;
+    s += sbit >> 3;
+    dbit &= 0x7;
+    sbit &= 0x7;
+
+    int shift = sbit - dbit;
+    int off = (shift < 0)? -1 : 0;
+    int r = shift & 0x7;
+    int last = (sbit + w - 1) >> 3;         // last source byte of the row
+    int n = (dbit + w + 7) >> 3;            // destination bytes touched
+
+    uint8_t head = 0xff >> dbit;
+    uint8_t tail = ((dbit + w) & 0x7)? ~(0xff >> ((dbit + w) & 0x7)) : 0xff;
+
+    if (n == 1)
+    {
+        rop_byte(rop, d, fetch_byte(s, off, last, r), head & tail);
+        return;
+    }
+
+    rop_byte(rop, d, fetch_byte(s, off, last, r), head);
+
+    int i = 1;
+    if (rop == ROP_COPY && r == 0)
+    {
+        memcpy(d + 1, s + 1, n - 2);
+        i = n - 1;
+    }
+    for(; i + 3 <= n - 2 && i + off + 4 <= last; i += 4)
+    {
+        const uint8_t* p = s + i + off;
+        uint32_t v = load_be32(p);
+        if (r)
+        {
+            v = (v << r) | (p[4] >> (8 - r));
+        }
+        store_be32(d + i, rop_apply(rop, load_be32(d + i), v));
+    }
+    for(; i < n - 1; ++i)
+    {
+        rop_byte(rop, d + i, fetch_byte(s, i + off, last, r), 0xff);
+    }
+
+    rop_byte(rop, d + i, fetch_byte(s, i + off, last, r), tail);
+}
+
+/* 8 source pixels from column x of row y, zero outside the bitmap */
+static inline uint8_t load8(const bitmap_t* b, int x, int y)
+{
+    if (y < 0 || y >= b->height)
+    {
+        return 0;
+    }
+    const uint8_t* row = b->bits + y * b->stride;
+    int i = x >> 3, r = x & 0x7;
+    uint8_t hi = (i >= 0 && i < b->stride)? row[i] : 0;
+    uint8_t lo = (r && i + 1 >= 0 && i + 1 < b->stride)? row[i + 1] : 0;
+    return (r)? (hi << r) | (lo >> (8 - r)) : hi;
+}
+
+/*
+ * The 8x8 tile of a rotated surface's bits at (tx, ty), row 0 in the top
+ * byte, gathered from src placed at (dx, dy) relative to the bits' origin in
+ * logical orientation, the source block starting at (sx, sy). Source rows
+ * are read 8 pixels at a time and turned with transpose8().
+ */
+static uint64_t rotated_tile(const surface_t* dst, const bitmap_t* src, int tx, int ty, int dx, int dy, int sx, int sy)
+{
+    int W = dst->width, H = dst->height;
+    uint64_t m = 0;
+    switch(dst->orientation)
+    {
+        case ROTATE_90:
+        {
+            // row k is source column cs + k, bit j source row rs - j
+            int cs = sx + ty - dx, rs = sy + H - 1 - tx - dy;
+            for(int j = 0; j < 8; ++j) m = (m << 8) | load8(src, cs, rs - j);
+            return transpose8(m);
+        }
+        case ROTATE_270:
+        {
+            // row k is source column cs - k, bit j source row rs + j
+            int cs = sx + W - 1 - ty - dx, rs = sy + tx - dy;
+            for(int j = 0; j < 8; ++j) m = (m << 8) | load8(src, cs - 7, rs + j);
+            // transposed, row k came out as row 7 - k
+            return __builtin_bswap64(transpose8(m));
+        }
+        default:
+        {
+            // row k is source row rs - k mirrored, bit j source column cs - j
+            int cs = sx + W - 1 - tx - dx, rs = sy + H - 1 - ty - dy;
+            for(int k = 0; k < 8; ++k) m = (m << 8) | (bitrev32(load8(src, cs - 7, rs - k)) >> 24);
+            return m;
+        }
+    }
+}
+
+/* the rectangle of the bits covered by the logical w by h block at (dx, dy) relative to the origin */
+static void rotated_rect(const surface_t* dst, int dx, int dy, int w, int h, int* x0, int* y0, int* x1, int* y1)
+{
+    int ax = dx + dst->org_x, ay = dy + dst->org_y, bx = ax + w - 1, by = ay + h - 1;
+    surface_to_bits(dst, &ax, &ay);
+    surface_to_bits(dst, &bx, &by);
+    *x0 = (ax < bx)? ax : bx;
+    *x1 = (ax < bx)? bx : ax;
+    *y0 = (ay < by)? ay : by;
+    *y1 = (ay < by)? by : ay;
+}
+
+/* mask of the bits of the byte at tx that lie in x0 to x1 */
+static inline uint8_t tile_mask(int tx, int x0, int x1)
+{
+    uint8_t mask = 0xff;
+    if (tx < x0) mask &= 0xff >> (x0 - tx);
+    if (tx + 7 > x1) mask &= 0xff << (tx + 7 - x1);
+    return mask;
+}
+
+/*
+ * blit() onto a rotated surface, (dx, dy) relative to the bits' origin in
+ * logical orientation. Works on 8x8 tiles aligned to the bytes of the bits,
+ * written back one masked byte per row.
+ */
+static void blit_rotated(surface_t* dst, int dx, int dy, const bitmap_t* src, int sx, int sy, int w, int h, rop_t rop)
+{
+    int x0, y0, x1, y1;
+    rotated_rect(dst, dx, dy, w, h, &x0, &y0, &x1, &y1);
+    for(int ty = y0; ty <= y1; ty += 8)
+    {
+        for(int tx = x0 & ~7; tx <= x1; tx += 8)
+        {
+            uint8_t mask = tile_mask(tx, x0, x1);
+            uint64_t m = rotated_tile(dst, src, tx, ty, dx, dy, sx, sy);
+            uint8_t* p = dst->bits + ty * dst->stride + (tx >> 3);
+            for(int k = 0; k < 8 && ty + k <= y1; ++k, p += dst->stride)
+            {
+                rop_byte(rop, p, m >> (56 - 8 * k), mask);
+            }
+        }
+    }
+}
+
+#define BLIT_ROWS(op) \
+    for(int y = 0; y < h; ++y) \
+    { \
+        blit_row(drow, dx, srow, sx, w, op); \
+        drow += stride; \
+        srow += src->stride; \
+    }
+
+/* the clipped block, (dx, dy) in the bits of an unrotated destination */
+static void blit_rows(uint8_t* bits, int stride, int dx, int dy, const bitmap_t* src, int sx, int sy, int w, int h, rop_t rop)
+{
+    uint8_t* drow = bits + dy * stride;
+    const uint8_t* srow = src->bits + sy * src->stride;
+
+    // one specialised copy of the row loop per operation
+    switch(rop)
+    {
+        case ROP_COPY:   BLIT_ROWS(ROP_COPY);   break;
+        case ROP_OR:     BLIT_ROWS(ROP_OR);     break;
+        case ROP_AND:    BLIT_ROWS(ROP_AND);    break;
+        case ROP_XOR:    BLIT_ROWS(ROP_XOR);    break;
+        case ROP_ANDNOT: BLIT_ROWS(ROP_ANDNOT); break;
+        case ROP_INVERT: BLIT_ROWS(ROP_INVERT); break;
+    }
+}
+
+void blit(surface_t* dst, int dx, int dy, const bitmap_t* src, int sx, int sy, int w, int h, rop_t rop)
+{
+    if (dst->list)
+    {
+        // the bitmap is referenced, not copied, and has to outlive the list
+        const int16_t args[] = { dx, dy, sx, sy, w, h, rop };
+        void* payload = dlist_record(dst->list, DL_BLIT, dx, dy, dx + w - 1, dy + h - 1,
+                                     args, sizeof(args) / sizeof(args[0]), sizeof(*src));
+        if (payload)
+        {
+            memcpy(payload, src, sizeof(*src));
+        }
+        return;
+    }
+
+    // clip against the source ...
+    if (sx < 0) { dx -= sx; w += sx; sx = 0; }
+    if (sy < 0) { dy -= sy; h += sy; sy = 0; }
+    if (sx + w > src->width) { w = src->width - sx; }
+    if (sy + h > src->height) { h = src->height - sy; }
+
+    // ... and against the destination's clip rectangle
+    const rect_t* c = &dst->clip;
+    if (dx < c->x0) { sx += c->x0 - dx; w -= c->x0 - dx; dx = c->x0; }
+    if (dy < c->y0) { sy += c->y0 - dy; h -= c->y0 - dy; dy = c->y0; }
+    if (dx + w > c->x1) { w = c->x1 - dx; }
+    if (dy + h > c->y1) { h = c->y1 - dy; }
+
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+    surface_mark_dirty(dst, dx, dy, dx + w - 1, dy + h - 1);
+
+    dx -= dst->org_x;
+    dy -= dst->org_y;
+    if (dst->orientation != ROTATE_0)
+    {
+        blit_rotated(dst, dx, dy, src, sx, sy, w, h, rop);
+        return;
+    }
+    blit_rows(dst->bits, dst->stride, dx, dy, src, sx, sy, w, h, rop);
+}
+
+static inline int surface_get(const surface_t* s, int x, int y)
+{
+    surface_to_bits(s, &x, &y);
+    return (s->bits[y * s->stride + (x >> 3)] >> (7 - (x & 7))) & 1;
+}
+
+void composite(surface_t* dst, int dx, int dy, const surface_t* src, int x0, int y0, int x1, int y1, rop_t rop)
+{
+    if (x0 > x1) { int t = x0; x0 = x1; x1 = t; }
+    if (y0 > y1) { int t = y0; y0 = y1; y1 = t; }
+    if (dst->list)
+    {
+        // the source surface is referenced and has to outlive the list
+        const int16_t args[] = { dx, dy, x0, y0, x1, y1, rop };
+        void* payload = dlist_record(dst->list, DL_COMPOSITE, dx, dy, dx + x1 - x0, dy + y1 - y0,
+                                     args, sizeof(args) / sizeof(args[0]), sizeof(src));
+        if (payload)
+        {
+            memcpy(payload, &src, sizeof(src));
+        }
+        return;
+    }
+
+    // clip against the source surface ...
+    int sx0 = src->org_x, sy0 = src->org_y;
+    if (x0 < sx0) { dx += sx0 - x0; x0 = sx0; }
+    if (y0 < sy0) { dy += sy0 - y0; y0 = sy0; }
+    if (x1 >= sx0 + src->width) { x1 = sx0 + src->width - 1; }
+    if (y1 >= sy0 + src->height) { y1 = sy0 + src->height - 1; }
+
+    // ... and against the destination's clip rectangle
+    const rect_t* c = &dst->clip;
+    if (dx < c->x0) { x0 += c->x0 - dx; dx = c->x0; }
+    if (dy < c->y0) { y0 += c->y0 - dy; dy = c->y0; }
+    if (dx + x1 - x0 >= c->x1) { x1 = x0 + c->x1 - 1 - dx; }
+    if (dy + y1 - y0 >= c->y1) { y1 = y0 + c->y1 - 1 - dy; }
+
+    int w = x1 - x0 + 1, h = y1 - y0 + 1;
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+    surface_mark_dirty(dst, dx, dy, dx + w - 1, dy + h - 1);
+    dx -= dst->org_x;
+    dy -= dst->org_y;
+
+    if (src->orientation == dst->orientation)
+    {
+        // turned the same way, the block is the same rectangle of both sets of bits
+        int bx0, by0, bx1, by1, ax0, ay0, ax1, ay1;
+        rotated_rect(dst, dx, dy, w, h, &bx0, &by0, &bx1, &by1);
+        rotated_rect(src, x0 - sx0, y0 - sy0, w, h, &ax0, &ay0, &ax1, &ay1);
+        int quarter = (src->orientation == ROTATE_90 || src->orientation == ROTATE_270);
+        bitmap_t bitmap = { src->bits, quarter? src->height : src->width, quarter? src->width : src->height, src->stride };
+        int bw = bx1 - bx0 + 1, bh = by1 - by0 + 1;
+        if (bw == 8 * dst->stride && dst->stride == src->stride)
+        {
+            // whole rows of both, the block is one run of words
+            bitmap.width = bw * bh;
+            bitmap.stride = bh * src->stride;
+            bitmap.bits += ay0 * src->stride;
+            blit_rows(dst->bits + by0 * dst->stride, 0, 0, 0, &bitmap, 0, 0, bw * bh, 1, rop);
+            return;
+        }
+        blit_rows(dst->bits, dst->stride, bx0, by0, &bitmap, ax0, ay0, bw, bh, rop);
+        return;
+    }
+
+    if (src->orientation == ROTATE_0)
+    {
+        bitmap_t bitmap = { src->bits, src->width, src->height, src->stride };
+        blit_rotated(dst, dx, dy, &bitmap, x0 - sx0, y0 - sy0, w, h, rop);
+        return;
+    }
+
+    // layers turned against each other, not worth a kernel of their own
+    for(int y = 0; y < h; ++y)
+    {
+        for(int x = 0; x < w; ++x)
+        {
+            int bx = dx + dst->org_x + x, by = dy + dst->org_y + y;
+            surface_to_bits(dst, &bx, &by);
+            uint8_t* p = dst->bits + by * dst->stride + (bx >> 3);
+            uint8_t s = surface_get(src, x0 + x, y0 + y)? 0xff : 0x00;
+            rop_byte(rop, p, s, 0x80 >> (bx & 7));
+        }
+    }
+}
+
+/* (d & ~mask) | (image & mask), a byte or a word at a time */
+#define MASKED(d, image, mask) (((d) & ~(mask)) | ((image) & (mask)))
+
+/*
+ * A row of a sprite, w bits from bit sbit of image and mask to bit dbit of
+ * d. The same funnel shift as blit_row(), done on both sources.
+ */
+static void sprite_row(uint8_t* d, int dbit, const uint8_t* image, const uint8_t* mask, int sbit, int w)
+{
+    d += dbit >> 3;
+    image += sbit >> 3;
+    mask += sbit >> 3;
+    dbit &= 0x7;
+    sbit &= 0x7;
+
+    int shift = sbit - dbit;
+    int off = (shift < 0)? -1 : 0;
+    int r = shift & 0x7;
+    int last = (sbit + w - 1) >> 3;
+    int n = (dbit + w + 7) >> 3;
+
+    uint8_t head = 0xff >> dbit;
+    uint8_t tail = ((dbit + w) & 0x7)? ~(0xff >> ((dbit + w) & 0x7)) : 0xff;
+    if (n == 1)
+    {
+        head &= tail;
+    }
+
+    uint8_t m = fetch_byte(mask, off, last, r) & head;
+    d[0] = MASKED(d[0], fetch_byte(image, off, last, r), m);
+    if (n == 1)
+    {
+        return;
+    }
+
+    int i = 1;
+    for(; i + 3 <= n - 2 && i + off + 4 <= last; i += 4)
+    {
+        const uint8_t* pi = image + i + off;
+        const uint8_t* pm = mask + i + off;
+        uint32_t vi = load_be32(pi), vm = load_be32(pm);
+        if (r)
+        {
+            vi = (vi << r) | (pi[4] >> (8 - r));
+            vm = (vm << r) | (pm[4] >> (8 - r));
+        }
+        store_be32(d + i, MASKED(load_be32(d + i), vi, vm));
+    }
+    for(; i < n - 1; ++i)
+    {
+        d[i] = MASKED(d[i], fetch_byte(image, i + off, last, r), fetch_byte(mask, i + off, last, r));
+    }
+
+    m = fetch_byte(mask, i + off, last, r) & tail;
+    d[i] = MASKED(d[i], fetch_byte(image, i + off, last, r), m);
+}
+
+void draw_sprite(surface_t* dst, int x, int y, const sprite_t* sprite)
+{
+    int w = sprite->width, h = sprite->height;
+    if (dst->list)
+    {
+        // like a blit, the sprite is referenced and has to outlive the list
+        const int16_t args[] = { x, y };
+        void* payload = dlist_record(dst->list, DL_SPRITE, x, y, x + w - 1, y + h - 1, args, 2, sizeof(*sprite));
+        if (payload)
+        {
+            memcpy(payload, sprite, sizeof(*sprite));
+        }
+        return;
+    }
+
+    int sx = 0, sy = 0;
+    const rect_t* c = &dst->clip;
+    if (x < c->x0) { sx = c->x0 - x; w -= sx; x = c->x0; }
+    if (y < c->y0) { sy = c->y0 - y; h -= sy; y = c->y0; }
+    if (x + w > c->x1) { w = c->x1 - x; }
+    if (y + h > c->y1) { h = c->y1 - y; }
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+    surface_mark_dirty(dst, x, y, x + w - 1, y + h - 1);
+    x -= dst->org_x;
+    y -= dst->org_y;
+
+    if (dst->orientation != ROTATE_0)
+    {
+        bitmap_t image = { sprite->bits, sprite->width, sprite->height, sprite->stride };
+        bitmap_t mask = { sprite->mask, sprite->width, sprite->height, sprite->stride };
+        int x0, y0, x1, y1;
+        rotated_rect(dst, x, y, w, h, &x0, &y0, &x1, &y1);
+        for(int ty = y0; ty <= y1; ty += 8)
+        {
+            for(int tx = x0 & ~7; tx <= x1; tx += 8)
+            {
+                uint8_t edge = tile_mask(tx, x0, x1);
+                uint64_t vi = rotated_tile(dst, &image, tx, ty, x, y, sx, sy);
+                uint64_t vm = rotated_tile(dst, &mask, tx, ty, x, y, sx, sy);
+                uint8_t* p = dst->bits + ty * dst->stride + (tx >> 3);
+                for(int k = 0; k < 8 && ty + k <= y1; ++k, p += dst->stride)
+                {
+                    *p = MASKED(*p, (uint8_t)(vi >> (56 - 8 * k)), (uint8_t)(vm >> (56 - 8 * k)) & edge);
+                }
+            }
+        }
+        return;
+    }
+
+    uint8_t* drow = dst->bits + y * dst->stride;
+    const uint8_t* irow = sprite->bits + sy * sprite->stride;
+    const uint8_t* mrow = sprite->mask + sy * sprite->stride;
+    for(int i = 0; i < h; ++i)
+    {
+        sprite_row(drow, x, irow, mrow, sx, w);
+        drow += dst->stride;
+        irow += sprite->stride;
+        mrow += sprite->stride;
+    }
+}
+
+/* 8 bits from bit position bit of row, zero outside its bytes */
+static inline uint8_t fetch_bits8(const uint8_t* row, int bit, int bytes)
+{
+    int i = bit >> 3, r = bit & 0x7;
+    uint8_t hi = (i >= 0 && i < bytes)? row[i] : 0;
+    uint8_t lo = (r && i + 1 >= 0 && i + 1 < bytes)? row[i + 1] : 0;
+    return (r)? (hi << r) | (lo >> (8 - r)) : hi;
+}
+
+/* fills bits a to b of row with the bits of fill */
+static void fill_bits(uint8_t* row, int a, int b, uint8_t fill)
+{
+    for(int i = a >> 3; i <= b >> 3; ++i)
+    {
+        uint8_t mask = 0xff;
+        if (i == a >> 3) mask &= 0xff >> (a & 7);
+        if (i == b >> 3) mask &= 0xff << (7 - (b & 7));
+        row[i] = (row[i] & ~mask) | (fill & mask);
+    }
+}
+
+/*
+ * Moves bits a to b of row right by k (left for negative k), in place, and
+ * fills the bits uncovered with fill. Destination byte i takes the 8 bits
+ * from bit 8 * i - k on; bytes are written in the direction of the move, so
+ * every source byte is read before it is overwritten, and the body of the
+ * row goes 32 bits at a time as a funnel shift.
+ */
+static void shift_bits(uint8_t* row, int bytes, int a, int b, int k, uint8_t fill)
+{
+    if (k >= b - a + 1 || -k >= b - a + 1)
+    {
+        fill_bits(row, a, b, fill);
+        return;
+    }
+    int da = (k > 0)? a + k : a;
+    int db = (k > 0)? b : b + k;
+    int ia = da >> 3, ib = db >> 3;
+    uint8_t head = 0xff >> (da & 7), tail = 0xff << (7 - (db & 7));
+    int q = k >> 3, r = k & 7;
+
+    if (k < 0)
+    {
+        int i = ia;
+        uint8_t v = fetch_bits8(row, 8 * i - k, bytes);
+        uint8_t mask = (ia == ib)? head & tail : head;
+        row[i] = (row[i] & ~mask) | (v & mask);
+        // source bytes i - q and i - q + 1 onwards, reading up to 5 bytes ahead
+        for(++i; i + 3 < ib && i - q + 4 < bytes; i += 4)
+        {
+            const uint8_t* p = row + i - q - (r? 1 : 0);
+            uint32_t w = load_be32(p);
+            if (r)
+            {
+                w = (w << (8 - r)) | (p[4] >> r);
+            }
+            store_be32(row + i, w);
+        }
+        for(; i <= ib; ++i)
+        {
+            v = fetch_bits8(row, 8 * i - k, bytes);
+            mask = (i == ib)? tail : 0xff;
+            row[i] = (row[i] & ~mask) | (v & mask);
+        }
+        fill_bits(row, db + 1, b, fill);
+    }
+    else
+    {
+        int i = ib;
+        uint8_t v = fetch_bits8(row, 8 * i - k, bytes);
+        uint8_t mask = (ia == ib)? head & tail : tail;
+        row[i] = (row[i] & ~mask) | (v & mask);
+        for(--i; i - 3 > ia && i - 3 - q - 1 >= 0; i -= 4)
+        {
+            const uint8_t* p = row + i - 3 - q - (r? 1 : 0);
+            uint32_t w = load_be32(p);
+            if (r)
+            {
+                w = (w << (8 - r)) | (p[4] >> r);
+            }
+            store_be32(row + i - 3, w);
+        }
+        for(; i >= ia; --i)
+        {
+            v = fetch_bits8(row, 8 * i - k, bytes);
+            mask = (i == ia)? head : 0xff;
+            row[i] = (row[i] & ~mask) | (v & mask);
+        }
+        fill_bits(row, a, da - 1, fill);
+    }
+}
+
+/* copies bits a to b of src to the same bits of dst */
+static void copy_bits(uint8_t* dst, const uint8_t* src, int a, int b)
+{
+    int ia = a >> 3, ib = b >> 3;
+    uint8_t head = 0xff >> (a & 7), tail = 0xff << (7 - (b & 7));
+    if (ia == ib)
+    {
+        head &= tail;
+    }
+    dst[ia] = (dst[ia] & ~head) | (src[ia] & head);
+    if (ia == ib)
+    {
+        return;
+    }
+    memmove(dst + ia + 1, src + ia + 1, ib - ia - 1);
+    dst[ib] = (dst[ib] & ~tail) | (src[ib] & tail);
+}
+
+void scroll_rect(surface_t* s, int x0, int y0, int x1, int y1, int dx, int dy, int color)
+{
+    if (s->list)
+    {
+        const int16_t args[] = { x0, y0, x1, y1, dx, dy, color };
+        dlist_record(s->list, DL_SCROLL, x0, y0, x1, y1, args, sizeof(args) / sizeof(args[0]), 0);
+        return;
+    }
+    if (x0 > x1) { int t = x0; x0 = x1; x1 = t; }
+    if (y0 > y1) { int t = y0; y0 = y1; y1 = t; }
+    const rect_t* c = &s->clip;
+    if (x0 < c->x0) x0 = c->x0;
+    if (y0 < c->y0) y0 = c->y0;
+    if (x1 >= c->x1) x1 = c->x1 - 1;
+    if (y1 >= c->y1) y1 = c->y1 - 1;
+    if (x0 > x1 || y0 > y1)
+    {
+        return;
+    }
+    surface_mark_dirty(s, x0, y0, x1, y1);
+
+    // the rectangle and the move in the bits
+    int ax = x0, ay = y0, bx = x1, by = y1;
+    surface_to_bits(s, &ax, &ay);
+    surface_to_bits(s, &bx, &by);
+    int a = (ax < bx)? ax : bx, b = (ax < bx)? bx : ax;
+    int top = (ay < by)? ay : by, bottom = (ay < by)? by : ay;
+    int vx = dx, vy = dy;
+    switch(s->orientation)
+    {
+        case ROTATE_0:   break;
+        case ROTATE_90:  vx = -dy; vy = dx;  break;
+        case ROTATE_180: vx = -dx; vy = -dy; break;
+        case ROTATE_270: vx = dy;  vy = -dx; break;
+    }
+    uint8_t fill = (color)? 0xff : 0x00;
+    int rows = bottom - top + 1;
+    int stride = s->stride;
+    uint8_t* first = s->bits + top * stride;
+
+    // whole rows first, then each row sideways
+    if (vy != 0)
+    {
+        int n = (vy > 0)? vy : -vy;
+        if (n > rows) n = rows;
+        int keep = rows - n;
+        uint8_t* from = first + ((vy > 0)? 0 : n * stride);
+        uint8_t* to = first + ((vy > 0)? n * stride : 0);
+        if (a == 0 && b == 8 * stride - 1)
+        {
+            // full rows are one block
+            memmove(to, from, keep * stride);
+        }
+        else if (vy > 0)
+        {
+            for(int i = keep - 1; i >= 0; --i) copy_bits(to + i * stride, from + i * stride, a, b);
+        }
+        else
+        {
+            for(int i = 0; i < keep; ++i) copy_bits(to + i * stride, from + i * stride, a, b);
+        }
+        uint8_t* exposed = first + ((vy > 0)? 0 : keep * stride);
+        for(int i = 0; i < n; ++i) fill_bits(exposed + i * stride, a, b, fill);
+    }
+    if (vx != 0)
+    {
+        for(int i = 0; i < rows; ++i) shift_bits(first + i * stride, stride, a, b, vx, fill);
+    }
+}
@@ -0,0 +1,125 @@
+
+#include <string.h>
+#include "cmdq.h"
+
+/*
+ * A bounded ring in the style of D. Vyukov's queue: every slot carries a
+ * sequence number telling whether it is free for the producer claiming
+ * position pos (seq == pos) or filled and ready for the consumer
+ * (seq == pos + 1). Producers claim positions with a compare-and-swap on the
+ * tail, so no one ever waits on a lock, not even an interrupted producer.
+ */
+
+int cmdq_init(cmdq_t* q, cmdq_slot_t* slots, uint32_t count)
+{
+    if (count == 0 || (count & (count - 1)))
+    {
+        return -1;
+    }
+    q->slots = slots;
+    q->mask = count - 1;
+    q->head = 0;
+    q->tail = 0;
+    q->dropped = 0;
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        slots[i].seq = i;
+    }
+    return 0;
+}
+
+int cmdq_post(cmdq_t* q, dl_op_t op, const int16_t* args, int argc,
+              const void* ptr0, const void* ptr1)
+{
+    if (argc > CMDQ_MAX_ARGS)
+    {
+        return -1;
+    }
+
+    cmdq_slot_t* slot;
+    uint32_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    for(;;)
+    {
+        slot = &q->slots[pos & q->mask];
+        int32_t dif = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (dif == 0)
+        {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+            // pos now holds the current tail, try again
+        }
+        else if (dif < 0)
+        {
+            // the consumer has not freed this slot yet: full
+            __atomic_fetch_add(&q->dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+        else
+        {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->op = op;
+    slot->argc = argc;
+    memcpy(slot->args, args, argc * sizeof(int16_t));
+    slot->ptr[0] = ptr0;
+    slot->ptr[1] = ptr1;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void exec(const cmdq_slot_t* slot, surface_t* s)
+{
+    const int16_t* a = slot->args;
+    switch(slot->op)
+    {
+        case DL_TEXT:
+            draw_text(s, (const char*)slot->ptr[0], a[0], a[1], a[2], (const lv_font_t*)slot->ptr[1], a[3], a[4]);
+            break;
+        case DL_BLIT:
+            blit(s, a[0], a[1], (const bitmap_t*)slot->ptr[0], a[2], a[3], a[4], a[5], (rop_t)a[6]);
+            break;
+        case DL_SPRITE:
+            draw_sprite(s, a[0], a[1], (const sprite_t*)slot->ptr[0]);
+            break;
+        case DL_COMPOSITE:
+            composite(s, a[0], a[1], (const surface_t*)slot->ptr[0], a[2], a[3], a[4], a[5], (rop_t)a[6]);
+            break;
+        case DL_FILLED_POLYGON:
+            draw_filled_polygons(s, (const point_t*)slot->ptr[0], (const int16_t*)slot->ptr[1], a[0], (fill_rule_t)a[1], a[2]);
+            break;
+        default:
+        {
+            // plain argument commands go through the display list decoder
+            uint32_t buf[(sizeof(dl_cmd_t) + CMDQ_MAX_ARGS * sizeof(int16_t) + 3) / 4];
+            dl_cmd_t* cmd = (dl_cmd_t*)buf;
+            cmd->op = slot->op;
+            cmd->argc = slot->argc;
+            cmd->size = sizeof(buf);
+            memcpy(cmd->args, slot->args, slot->argc * sizeof(int16_t));
+            dlist_exec(cmd, s);
+            break;
+        }
+    }
+}
+
+int cmdq_drain(cmdq_t* q, surface_t* s)
+{
+    int n = 0;
+    for(;;)
+    {
+        cmdq_slot_t* slot = &q->slots[q->head & q->mask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != q->head + 1)
+        {
+            return n;
+        }
+        exec(slot, s);
+        // hand the slot back for the producer one lap ahead
+        __atomic_store_n(&slot->seq, q->head + q->mask + 1, __ATOMIC_RELEASE);
+        ++q->head;
+        ++n;
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * Lock-free queue of draw commands. Any number of tasks and interrupt
+ * handlers post commands, one render task drains them onto a surface.
+ * Posting never blocks and never allocates: when the ring is full the command
+ * is dropped and counted.
+ */
+
+/* inclusion guard */
+#ifndef __CMDQ_H__
+#define __CMDQ_H__
+
+#include <stdint.h>
+
+#include "epaper.h"
+#include "dlist.h"
+
+#define CMDQ_MAX_ARGS 7
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /*
+     * One queued command. The arguments are those of the display list opcode;
+     * DL_TEXT takes the string and the font in ptr[0] and ptr[1], DL_BLIT the
+     * bitmap_t, DL_SPRITE the sprite_t and DL_COMPOSITE the source surface in
+     * ptr[0], DL_FILLED_POLYGON the points and the counts. The pointers must stay valid until the command
+     * has been drained.
+     */
+    typedef struct
+    {
+        uint32_t seq;
+        uint8_t op;
+        uint8_t argc;
+        int16_t args[CMDQ_MAX_ARGS];
+        const void* ptr[2];
+    } cmdq_slot_t;
+
+    typedef struct
+    {
+        cmdq_slot_t* slots;
+        uint32_t mask;
+        uint32_t head;          // next slot to drain, owned by the consumer
+        uint32_t tail;          // next slot to claim, shared by the producers
+        uint32_t dropped;       // commands lost to a full ring
+    } cmdq_t;
+
+    /*
+     * Sets up a queue over count slots, count must be a power of two.
+     * Returns 0 on success, -1 for a bad count.
+     */
+    extern int cmdq_init(cmdq_t* q, cmdq_slot_t* slots, uint32_t count);
+
+    /*
+     * Posts a command, safe from any task or ISR on either core. Returns 0,
+     * or -1 if the ring is full.
+     */
+    extern int cmdq_post(cmdq_t* q, dl_op_t op, const int16_t* args, int argc,
+                         const void* ptr0, const void* ptr1);
+
+    /*
+     * Executes every command posted so far on s, in the order the producers
+     * claimed their slots, and returns how many were run. Must only be called
+     * from one task at a time. A command whose producer was interrupted while
+     * filling in its slot ends the drain early; it is run next time.
+     */
+    extern int cmdq_drain(cmdq_t* q, surface_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CMDQ_H__ */
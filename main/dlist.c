@@ -0,0 +1,384 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "dlist.h"
+
+#define min(a, b) ((a) < (b)? (a) : (b))
+#define max(a, b) ((a) > (b)? (a) : (b))
+
+// occluders remembered while walking a list back to front
+#define MAX_COVERS 8
+
+// marks an entry of the offset table as removed
+#define DROPPED 0x80000000u
+
+static int16_t sat16(int v)
+{
+    return (v < INT16_MIN)? INT16_MIN : (v > INT16_MAX)? INT16_MAX : v;
+}
+
+void dlist_init(dlist_t* dl, void* buf, uint32_t size)
+{
+    dl->buf = (uint8_t*)buf;
+    dl->size = size & ~3u;
+    dlist_reset(dl);
+}
+
+void dlist_reset(dlist_t* dl)
+{
+    dl->used = 0;
+    dl->overflow = 0;
+}
+
+void dlist_surface(dlist_t* dl, surface_t* s, int width, int height)
+{
+    surface_init(s, NULL, width, height);
+    s->list = dl;
+}
+
+void* dlist_record(dlist_t* dl, dl_op_t op, int x0, int y0, int x1, int y1,
+                   const int16_t* args, int argc, int length)
+{
+    uint32_t offset = (sizeof(dl_cmd_t) + argc * sizeof(int16_t) + 3) & ~3u;
+    uint32_t size = (offset + length + 3) & ~3u;
+    if (dl->used + size > dl->size || size > UINT16_MAX)
+    {
+        dl->overflow = 1;
+        return NULL;
+    }
+
+    dl_cmd_t* cmd = (dl_cmd_t*)(dl->buf + dl->used);
+    cmd->op = op;
+    cmd->argc = argc;
+    cmd->size = size;
+    cmd->bounds.x0 = sat16(min(x0, x1));
+    cmd->bounds.y0 = sat16(min(y0, y1));
+    cmd->bounds.x1 = sat16(max(x0, x1) + 1);
+    cmd->bounds.y1 = sat16(max(y0, y1) + 1);
+    memcpy(cmd->args, args, argc * sizeof(int16_t));
+    dl->used += size;
+    return (uint8_t*)cmd + offset;
+}
+
+void dlist_exec(const dl_cmd_t* cmd, surface_t* s)
+{
+    const int16_t* a = cmd->args;
+    switch(cmd->op)
+    {
+        case DL_CLEAR:
+            clear(s, a[0]);
+            break;
+        case DL_PIXEL:
+            set_pixel(s, a[0], a[1], a[2]);
+            break;
+        case DL_LINE:
+            draw_line(s, a[0], a[1], a[2], a[3], a[4]);
+            break;
+        case DL_CIRCLE:
+            draw_circle(s, a[0], a[1], a[2], a[3]);
+            break;
+        case DL_FILLED_CIRCLE:
+            draw_filled_circle(s, a[0], a[1], a[2], a[3]);
+            break;
+        case DL_FILLED_ELLIPSE:
+            draw_filled_ellipse(s, a[0], a[1], a[2], a[3], a[4]);
+            break;
+        case DL_RECT:
+            draw_rect(s, a[0], a[1], a[2], a[3], a[4]);
+            break;
+        case DL_FILLED_RECT:
+            draw_filled_rect(s, a[0], a[1], a[2], a[3], a[4]);
+            break;
+        case DL_TEXT:
+        {
+            const uint8_t* payload = (const uint8_t*)dlist_payload(cmd);
+            const lv_font_t* font;
+            memcpy(&font, payload, sizeof(font));
+            draw_text(s, (const char*)payload + sizeof(font), a[0], a[1], a[2], font, a[3], a[4]);
+            break;
+        }
+        case DL_BLIT:
+        {
+            bitmap_t bitmap;
+            memcpy(&bitmap, dlist_payload(cmd), sizeof(bitmap));
+            blit(s, a[0], a[1], &bitmap, a[2], a[3], a[4], a[5], (rop_t)a[6]);
+            break;
+        }
+        case DL_SPRITE:
+        {
+            sprite_t sprite;
+            memcpy(&sprite, dlist_payload(cmd), sizeof(sprite));
+            draw_sprite(s, a[0], a[1], &sprite);
+            break;
+        }
+        case DL_COMPOSITE:
+        {
+            const surface_t* src;
+            memcpy(&src, dlist_payload(cmd), sizeof(src));
+            composite(s, a[0], a[1], src, a[2], a[3], a[4], a[5], (rop_t)a[6]);
+            break;
+        }
+        case DL_ROUND_RECT:
+            draw_round_rect(s, a[0], a[1], a[2], a[3], a[4], a[5]);
+            break;
+        case DL_FILLED_ROUND_RECT:
+            draw_filled_round_rect(s, a[0], a[1], a[2], a[3], a[4], a[5]);
+            break;
+        case DL_ARC:
+            draw_arc(s, a[0], a[1], a[2], a[3], a[4], a[5]);
+            break;
+        case DL_FILLED_ARC:
+            draw_filled_arc(s, a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+            break;
+        case DL_DASH:
+            // through the setter, so a list replayed into another one keeps it
+            surface_set_dash(s, ((uint32_t)(uint16_t)a[0] << 16) | (uint16_t)a[1], 32);
+            s->dash_phase = a[2];
+            break;
+        case DL_PATTERN:
+            surface_set_pattern(s, ((uint64_t)(uint16_t)a[0] << 48) | ((uint64_t)(uint16_t)a[1] << 32) |
+                                   ((uint64_t)(uint16_t)a[2] << 16) | (uint16_t)a[3]);
+            break;
+        case DL_FLOOD_FILL:
+            flood_fill(s, a[0], a[1], a[2]);
+            break;
+        case DL_SCROLL:
+            scroll_rect(s, a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+            break;
+        case DL_FILLED_POLYGON:
+        {
+            const int16_t* counts = (const int16_t*)dlist_payload(cmd);
+            draw_filled_polygons(s, (const point_t*)(counts + a[0]), counts, a[0], (fill_rule_t)a[1], a[2]);
+            break;
+        }
+    }
+}
+
+void dlist_replay(const dlist_t* dl, surface_t* s)
+{
+    // the list starts out with solid lines and fills like a new surface, and
+    // the state it sets only applies during the replay; through the setters,
+    // so that a list being recorded into follows along
+    uint32_t dash = s->dash;
+    int dash_phase = s->dash_phase;
+    uint64_t pattern = s->pattern;
+    surface_set_dash(s, DASH_SOLID, 32);
+    surface_set_pattern(s, PATTERN_SOLID);
+    const rect_t* c = &s->clip;
+    for(const dl_cmd_t* cmd = dlist_first(dl); cmd; cmd = dlist_next(dl, cmd))
+    {
+        const rect_t* b = &cmd->bounds;
+        if (b->x1 <= c->x0 || b->x0 >= c->x1 || b->y1 <= c->y0 || b->y0 >= c->y1)
+        {
+            continue;
+        }
+        dlist_exec(cmd, s);
+    }
+    surface_set_dash(s, dash, 32);
+    s->dash_phase = dash_phase;
+    surface_set_pattern(s, pattern);
+}
+
+void dlist_render(surface_t* s, void* ctx)
+{
+    dlist_replay((const dlist_t*)ctx, s);
+}
+
+static int32_t area(const rect_t* r)
+{
+    return (int32_t)(r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static int contains(const rect_t* outer, const rect_t* inner)
+{
+    return outer->x0 <= inner->x0 && outer->y0 <= inner->y0 &&
+           outer->x1 >= inner->x1 && outer->y1 >= inner->y1;
+}
+
+/*
+ * The rectangle a command is guaranteed to paint over completely, whatever
+ * was there before. Returns 0 for commands that leave some pixels alone.
+ */
+static int opaque_cover(const dl_cmd_t* cmd, rect_t* cover)
+{
+    const int16_t* a = cmd->args;
+    switch(cmd->op)
+    {
+        case DL_CLEAR:
+        case DL_FILLED_RECT:
+            *cover = cmd->bounds;
+            return 1;
+        case DL_FILLED_ROUND_RECT:
+        {
+            // the full-width band between the corners
+            int r = a[4];
+            *cover = cmd->bounds;
+            r = min(r, (cover->x1 - cover->x0 - 1) / 2);
+            r = min(r, (cover->y1 - cover->y0 - 1) / 2);
+            if (r > 0)
+            {
+                cover->y0 += r;
+                cover->y1 -= r;
+            }
+            return 1;
+        }
+        case DL_FILLED_CIRCLE:
+        {
+            // the inscribed square, all of its rows are at least k wide; the
+            // midpoint circle dips to within about r - 1 of the centre
+            int r = a[2], k = 0;
+            while(2 * (k + 1) * (k + 1) <= r * r - 2 * r) ++k;
+            cover->x0 = a[0] - k;
+            cover->y0 = a[1] - k;
+            cover->x1 = a[0] + k + 1;
+            cover->y1 = a[1] + k + 1;
+            return 1;
+        }
+        case DL_BLIT:
+        {
+            bitmap_t bitmap;
+            memcpy(&bitmap, dlist_payload(cmd), sizeof(bitmap));
+            if ((a[6] != ROP_COPY && a[6] != ROP_INVERT) || a[4] <= 0 || a[5] <= 0 ||
+                a[2] < 0 || a[3] < 0 || a[2] + a[4] > bitmap.width || a[3] + a[5] > bitmap.height)
+            {
+                return 0;
+            }
+            *cover = cmd->bounds;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* two rectangles whose union is a rectangle again */
+static int joinable(const rect_t* a, const rect_t* b)
+{
+    if (a->x0 == b->x0 && a->x1 == b->x1)
+    {
+        return b->y0 <= a->y1 && a->y0 <= b->y1;
+    }
+    if (a->y0 == b->y0 && a->y1 == b->y1)
+    {
+        return b->x0 <= a->x1 && a->x0 <= b->x1;
+    }
+    return 0;
+}
+
+int dlist_optimize(dlist_t* dl)
+{
+    int count = 0;
+    for(const dl_cmd_t* cmd = dlist_first(dl); cmd; cmd = dlist_next(dl, cmd))
+    {
+        ++count;
+    }
+    if (count < 2)
+    {
+        return 0;
+    }
+
+    // one allocation per pass for the offsets, commands can only be walked forward
+    uint32_t* offsets = (uint32_t*)malloc(count * sizeof(uint32_t));
+    if (offsets == NULL)
+    {
+        return 0;
+    }
+    int n = 0;
+    for(const dl_cmd_t* cmd = dlist_first(dl); cmd; cmd = dlist_next(dl, cmd))
+    {
+        offsets[n++] = (const uint8_t*)cmd - dl->buf;
+    }
+
+    // back to front: drop what later opaque commands paint over
+    rect_t covers[MAX_COVERS];
+    int ncovers = 0;
+    int dropped = 0;
+    for(int i = count - 1; i >= 0; --i)
+    {
+        dl_cmd_t* cmd = (dl_cmd_t*)(dl->buf + offsets[i]);
+        int covered = 0;
+        for(int k = 0; k < ncovers && !covered; ++k)
+        {
+            covered = contains(&covers[k], &cmd->bounds);
+        }
+        if (covered)
+        {
+            offsets[i] |= DROPPED;
+            ++dropped;
+            continue;
+        }
+
+        if (cmd->op == DL_FLOOD_FILL || cmd->op == DL_SCROLL)
+        {
+            // what it fills depends on everything before it
+            ncovers = 0;
+            continue;
+        }
+
+        rect_t cover;
+        if (!opaque_cover(cmd, &cover) || cover.x0 >= cover.x1 || cover.y0 >= cover.y1)
+        {
+            continue;
+        }
+        if (ncovers < MAX_COVERS)
+        {
+            covers[ncovers++] = cover;
+            continue;
+        }
+        // keep the largest occluders
+        int smallest = 0;
+        for(int k = 1; k < ncovers; ++k)
+        {
+            if (area(&covers[k]) < area(&covers[smallest])) smallest = k;
+        }
+        if (area(&covers[smallest]) < area(&cover))
+        {
+            covers[smallest] = cover;
+        }
+    }
+
+    // front to back: merge consecutive fills of the same color
+    dl_cmd_t* prev = NULL;
+    for(int i = 0; i < count; ++i)
+    {
+        if (offsets[i] & DROPPED)
+        {
+            continue;
+        }
+        dl_cmd_t* cmd = (dl_cmd_t*)(dl->buf + offsets[i]);
+        if (prev && prev->op == DL_FILLED_RECT && cmd->op == DL_FILLED_RECT &&
+            prev->args[4] == cmd->args[4] && joinable(&prev->bounds, &cmd->bounds))
+        {
+            rect_t* b = &prev->bounds;
+            b->x0 = min(b->x0, cmd->bounds.x0);
+            b->y0 = min(b->y0, cmd->bounds.y0);
+            b->x1 = max(b->x1, cmd->bounds.x1);
+            b->y1 = max(b->y1, cmd->bounds.y1);
+            // draw_filled_rect takes inclusive x but an exclusive y1
+            prev->args[0] = b->x0;
+            prev->args[1] = b->y0;
+            prev->args[2] = b->x1 - 1;
+            prev->args[3] = b->y1;
+            offsets[i] |= DROPPED;
+            ++dropped;
+            continue;
+        }
+        prev = cmd;
+    }
+
+    uint32_t used = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        if (offsets[i] & DROPPED)
+        {
+            continue;
+        }
+        const dl_cmd_t* cmd = (const dl_cmd_t*)(dl->buf + offsets[i]);
+        uint32_t size = cmd->size;
+        memmove(dl->buf + used, cmd, size);
+        used += size;
+    }
+    dl->used = used;
+
+    free(offsets);
+    return dropped;
+}
@@ -0,0 +1,130 @@
+/*
+ * Retained display lists. A surface set up with dlist_surface() records every
+ * primitive drawn on it, with all of its parameters, into a preallocated
+ * buffer instead of rasterizing it. The list can then be replayed onto any
+ * surface, e.g. several times at different places, band by band, or on
+ * several cores at once.
+ */
+
+/* inclusion guard */
+#ifndef __DLIST_H__
+#define __DLIST_H__
+
+#include <stdint.h>
+
+#include "epaper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef enum
+    {
+        DL_CLEAR,               /* color */
+        DL_PIXEL,               /* x, y, color */
+        DL_LINE,                /* x0, y0, x1, y1, color */
+        DL_CIRCLE,              /* xc, yc, r, color */
+        DL_FILLED_CIRCLE,       /* xc, yc, r, color */
+        DL_FILLED_ELLIPSE,      /* xc, yc, a, b, color */
+        DL_RECT,                /* x0, y0, x1, y1, color */
+        DL_FILLED_RECT,         /* x0, y0, x1, y1, color */
+        DL_TEXT,                /* x0, y0, color, xoff, yoff; font pointer and string */
+        DL_BLIT,                /* dx, dy, sx, sy, w, h, rop; bitmap_t */
+        DL_FILLED_POLYGON,      /* ncontours, rule, color; counts and points */
+        DL_ROUND_RECT,          /* x0, y0, x1, y1, r, color */
+        DL_FILLED_ROUND_RECT,   /* x0, y0, x1, y1, r, color */
+        DL_ARC,                 /* xc, yc, r, start, end, color */
+        DL_FILLED_ARC,          /* xc, yc, r0, r1, start, end, color */
+        DL_DASH,                /* pattern high, pattern low, phase; state, never culled */
+        DL_PATTERN,             /* pattern, most significant quarter first; state, never culled */
+        DL_FLOOD_FILL,          /* x, y, color; never culled */
+        DL_SCROLL,              /* x0, y0, x1, y1, dx, dy, color */
+        DL_SPRITE,              /* x, y; sprite_t */
+        DL_COMPOSITE            /* dx, dy, x0, y0, x1, y1, rop; surface_t pointer */
+    } dl_op_t;
+
+    /*
+     * One recorded command: the header, argc 16 bit arguments and an optional
+     * payload starting at the next 32 bit boundary. Commands are padded to a
+     * multiple of 4 bytes.
+     */
+    typedef struct
+    {
+        uint8_t op;
+        uint8_t argc;
+        uint16_t size;          /* bytes, header, arguments and payload */
+        rect_t bounds;          /* everything the command may touch */
+        int16_t args[];
+    } dl_cmd_t;
+
+    typedef struct dlist
+    {
+        uint8_t* buf;           /* 32 bit aligned */
+        uint32_t size;
+        uint32_t used;
+        int overflow;           /* a command did not fit, the list is incomplete */
+    } dlist_t;
+
+    extern void dlist_init(dlist_t* dl, void* buf, uint32_t size);
+    extern void dlist_reset(dlist_t* dl);
+
+    /*
+     * Turns s into a recording surface of width by height pixels: everything
+     * drawn on it is appended to dl. Recording never allocates; once the
+     * buffer is full further commands are dropped and overflow is set.
+     */
+    extern void dlist_surface(dlist_t* dl, surface_t* s, int width, int height);
+
+    /*
+     * Appends a command with the inclusive bounds (x0, y0) - (x1, y1) and
+     * returns where its payload of length bytes goes, NULL if it did not
+     * fit. Used by the primitives when they draw on a recording surface.
+     */
+    extern void* dlist_record(dlist_t* dl, dl_op_t op, int x0, int y0, int x1, int y1,
+                              const int16_t* args, int argc, int length);
+
+    static inline const dl_cmd_t* dlist_first(const dlist_t* dl)
+    {
+        return dl->used? (const dl_cmd_t*)dl->buf : NULL;
+    }
+
+    static inline const dl_cmd_t* dlist_next(const dlist_t* dl, const dl_cmd_t* cmd)
+    {
+        const uint8_t* next = (const uint8_t*)cmd + cmd->size;
+        return (next < dl->buf + dl->used)? (const dl_cmd_t*)next : NULL;
+    }
+
+    /* payload of a command, see dl_op_t */
+    static inline const void* dlist_payload(const dl_cmd_t* cmd)
+    {
+        return (const uint8_t*)cmd + ((sizeof(dl_cmd_t) + cmd->argc * sizeof(int16_t) + 3) & ~3u);
+    }
+
+    /* executes a single command on s */
+    extern void dlist_exec(const dl_cmd_t* cmd, surface_t* s);
+
+    /*
+     * Replays the whole list onto s. Commands whose bounds miss the clip
+     * rectangle of s are skipped without being decoded.
+     */
+    extern void dlist_replay(const dlist_t* dl, surface_t* s);
+
+    /* dlist_replay() shaped as a render_fn, ctx is the dlist_t */
+    extern void dlist_render(surface_t* s, void* ctx);
+
+    /*
+     * Optimizes a recorded list in place without changing what it draws:
+     * commands that are entirely painted over by later opaque ones (clears,
+     * filled rectangles, the core of filled circles, opaque blits) are
+     * dropped, and runs of filled rectangles of the same color that join up
+     * into a single rectangle are merged. Flood fills and scrolls depend on
+     * what was drawn before them, nothing is dropped across one. Returns the
+     * number of commands removed.
+     */
+    extern int dlist_optimize(dlist_t* dl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DLIST_H__ */
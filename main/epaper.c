@@ -3,43 +3,229 @@
 #include <string.h>
 #include <math.h>
 #include "epaper.h"
+#include "dlist.h"
+#include "fixmath.h"
+#include "bitops.h"
 
 #define order(a, b) if (a > b) { int c = a; a = b; b = c; }
 #define set_bitmask(p, mask, color) if (color) { *p |= mask; } else { *p &= ~mask; } 
 
-uint8_t framebuffer[EPD_BYTES];
+// word aligned for framediff and the word-wise surface operations
+uint8_t framebuffer[EPD_FRAME_BYTES] __attribute__((aligned(4)));
 
-void set_pixel(int x, int y, int color)
+surface_t screen = {
+    framebuffer, EPD_WIDTH, EPD_HEIGHT, EPD_BYTES_PER_ROW,
+    0, 0, { 0, 0, EPD_WIDTH, EPD_HEIGHT }, { 0 }, NULL, DASH_SOLID, 0, PATTERN_SOLID, ROTATE_0
+};
+
+void surface_init(surface_t* s, uint8_t* bits, int width, int height)
+{
+    surface_init_band(s, bits, width, 0, height);
+}
+
+void surface_init_band(surface_t* s, uint8_t* bits, int width, int y, int height)
 {
-    if (x < 0 || x >= EPD_WIDTH || y < 0 || y >= EPD_HEIGHT)
+    s->bits = bits;
+    s->width = width;
+    s->height = height;
+    s->stride = (width + 7) >> 3;
+    s->org_x = 0;
+    s->org_y = y;
+    s->clip.x0 = 0;
+    s->clip.y0 = y;
+    s->clip.x1 = width;
+    s->clip.y1 = y + height;
+    region_clear(&s->dirty);
+    s->list = NULL;
+    s->dash = DASH_SOLID;
+    s->dash_phase = 0;
+    s->pattern = PATTERN_SOLID;
+    s->orientation = ROTATE_0;
+}
+
+void surface_set_clip(surface_t* s, int x0, int y0, int x1, int y1)
+{
+    order(x0, x1);
+    order(y0, y1);
+    int left = s->org_x, top = s->org_y;
+    s->clip.x0 = x0 < left? left : x0;
+    s->clip.y0 = y0 < top? top : y0;
+    s->clip.x1 = x1 >= left + s->width? left + s->width : x1 + 1;
+    s->clip.y1 = y1 >= top + s->height? top + s->height : y1 + 1;
+    if (s->clip.x1 < s->clip.x0) s->clip.x1 = s->clip.x0;
+    if (s->clip.y1 < s->clip.y0) s->clip.y1 = s->clip.y0;
+}
+
+void surface_set_orientation(surface_t* s, rotation_t rot)
+{
+    if ((rot ^ s->orientation) & 1)
     {
-        return;
+        int w = s->width;
+        s->width = s->height;
+        s->height = w;
     }
+    s->orientation = rot;
+    s->org_x = 0;
+    s->org_y = 0;
+    s->clip.x0 = 0;
+    s->clip.y0 = 0;
+    s->clip.x1 = s->width;
+    s->clip.y1 = s->height;
+}
 
-    int pos = (y * EPD_WIDTH + x) / 8;
-    uint8_t bitmask = 0x80 >> (x & 0x7);
-    set_bitmask((framebuffer + pos), bitmask, color);
+void surface_set_dash(surface_t* s, uint32_t pattern, int bits)
+{
+    // repeated to 32 bits, so the phase simply wraps at 32
+    if (bits == 8)
+    {
+        pattern = (pattern & 0xff) * 0x01010101u;
+    }
+    else if (bits == 16)
+    {
+        pattern = (pattern & 0xffff) * 0x00010001u;
+    }
+    s->dash = pattern;
+    s->dash_phase = 0;
+    if (s->list)
+    {
+        // dashed outlines record their own phase, but a solid one records nothing
+        const int16_t args[] = { (int16_t)(pattern >> 16), (int16_t)pattern, 0 };
+        dlist_record(s->list, DL_DASH, INT16_MIN, INT16_MIN, INT16_MAX, INT16_MAX, args, 3, 0);
+    }
+}
+
+void surface_set_pattern(surface_t* s, uint64_t pattern)
+{
+    if (pattern == s->pattern)
+    {
+        return;
+    }
+    s->pattern = pattern;
+    if (s->list)
+    {
+        const int16_t args[] = { (int16_t)(pattern >> 48), (int16_t)(pattern >> 32), (int16_t)(pattern >> 16), (int16_t)pattern };
+        dlist_record(s->list, DL_PATTERN, INT16_MIN, INT16_MIN, INT16_MAX, INT16_MAX, args, 4, 0);
+    }
 }
 
-void clear(int color)
+uint64_t pattern_gray(int level)
 {
-    memset(framebuffer, color? 0xff : 0x00, sizeof(framebuffer));
+    // ordered dither, each level adds one pixel to those of the level below
+    static const uint8_t bayer[8][8] =
+    {
+        {  0, 32,  8, 40,  2, 34, 10, 42 },
+        { 48, 16, 56, 24, 50, 18, 58, 26 },
+        { 12, 44,  4, 36, 14, 46,  6, 38 },
+        { 60, 28, 52, 20, 62, 30, 54, 22 },
+        {  3, 35, 11, 43,  1, 33,  9, 41 },
+        { 51, 19, 59, 27, 49, 17, 57, 25 },
+        { 15, 47,  7, 39, 13, 45,  5, 37 },
+        { 63, 31, 55, 23, 61, 29, 53, 21 }
+    };
+    uint64_t pattern = 0;
+    for(int y = 0; y < 8; ++y)
+    {
+        for(int x = 0; x < 8; ++x)
+        {
+            pattern = (pattern << 1) | (bayer[y][x] < level);
+        }
+    }
+    return pattern;
 }
 
-static int clip(int a, int m)
+void surface_translate(surface_t* s, int dx, int dy)
 {
-    return (a < 0)? 0 : (a >= m)? m - 1 : a;
+    // a logical x now lands where x + dx used to
+    s->org_x -= dx;
+    s->org_y -= dy;
+    s->clip.x0 -= dx;
+    s->clip.x1 -= dx;
+    s->clip.y0 -= dy;
+    s->clip.y1 -= dy;
 }
 
-static void hLine(int x0, int x1, int y, int color)
+/* recording surfaces append the call to their display list instead of drawing */
+#define RECORD(s, op, x0, y0, x1, y1, ...) \
+    if (s->list) \
+    { \
+        const int16_t args[] = { __VA_ARGS__ }; \
+        dlist_record(s->list, op, x0, y0, x1, y1, args, sizeof(args) / sizeof(args[0]), 0); \
+        return; \
+    }
+
+/* takes inclusive corners in any order, clips them to the surface */
+void surface_mark_dirty(surface_t* s, int x0, int y0, int x1, int y1)
 {
-    x0 = clip(x0, EPD_WIDTH);
-    x1 = clip(x1, EPD_WIDTH);
-    y =  clip(y, EPD_HEIGHT);
     order(x0, x1);
-    ++x1;
-    
-    uint8_t* p = framebuffer + y * EPD_BYTES_PER_ROW;
+    order(y0, y1);
+    const rect_t* c = &s->clip;
+    if (x1 < c->x0 || y1 < c->y0 || x0 >= c->x1 || y0 >= c->y1)
+    {
+        return;
+    }
+    rect_t r = {
+        x0 < c->x0? c->x0 : x0,
+        y0 < c->y0? c->y0 : y0,
+        x1 >= c->x1? c->x1 : x1 + 1,
+        y1 >= c->y1? c->y1 : y1 + 1
+    };
+    if (s->orientation != ROTATE_0)
+    {
+        int ax = r.x0, ay = r.y0, bx = r.x1 - 1, by = r.y1 - 1;
+        surface_to_bits(s, &ax, &ay);
+        surface_to_bits(s, &bx, &by);
+        order(ax, bx);
+        order(ay, by);
+        rect_t b = { ax, ay, bx + 1, by + 1 };
+        r = b;
+    }
+    region_add(&s->dirty, &r);
+}
+
+void surface_reset_dirty(surface_t* s)
+{
+    region_clear(&s->dirty);
+}
+
+/* address of the byte holding logical pixel (x, y) */
+static inline uint8_t* pixel_byte(surface_t* s, int x, int y)
+{
+    return s->bits + (y - s->org_y) * s->stride + ((x - s->org_x) >> 3);
+}
+
+static void pixel(surface_t* s, int x, int y, int color)
+{
+    if (x < s->clip.x0 || x >= s->clip.x1 || y < s->clip.y0 || y >= s->clip.y1)
+    {
+        return;
+    }
+
+    if (s->orientation != ROTATE_0)
+    {
+        surface_to_bits(s, &x, &y);
+        x += s->org_x;
+        y += s->org_y;
+    }
+    uint8_t* p = pixel_byte(s, x, y);
+    uint8_t bitmask = 0x80 >> ((x - s->org_x) & 0x7);
+    set_bitmask(p, bitmask, color);
+}
+
+void set_pixel(surface_t* s, int x, int y, int color)
+{
+    RECORD(s, DL_PIXEL, x, y, x, y, x, y, color);
+    surface_mark_dirty(s, x, y, x, y);
+    pixel(s, x, y, color);
+}
+
+static int clamp(int a, int lo, int hi)
+{
+    return (a < lo)? lo : (a > hi)? hi : a;
+}
+
+/* writes the bits of fill to the pixels x0 to x1 - 1 of a row of the bits */
+static void spanBits(uint8_t* p, int x0, int x1, uint8_t fill)
+{
     uint8_t* end = p + (x1 >> 3);
     p += (x0 >> 3);
 
@@ -53,11 +239,10 @@ static void hLine(int x0, int x1, int y, int color)
             startByte &= endByte;
             endByte = 0x00;
         }
-        set_bitmask(p, startByte, color);
+        *p = (*p & ~startByte) | (fill & startByte);
         ++p;
     }
     
-    uint8_t fill = (color)? 0xff : 0x00;
     while(p < end)
     {
         *p++ = fill;
@@ -65,25 +250,129 @@ static void hLine(int x0, int x1, int y, int color)
 
     if (endByte)
     {
-        set_bitmask(p, endByte, color);
+        *p = (*p & ~endByte) | (fill & endByte);
+    }
+}
+
+/*
+ * A run of n pixels down or up a column of the bits, starting at p with
+ * mask; pixel i takes bit i0 + i of fill, counted modulo 8 from the top.
+ */
+static void spanColumn(uint8_t* p, uint8_t mask, int step, int n, uint8_t fill, int i0)
+{
+    for(int i = 0; i < n; ++i, p += step)
+    {
+        if ((fill << ((i0 + i) & 7)) & 0x80)
+            *p |= mask;
+        else
+            *p &= ~mask;
     }
 }
 
-static void vLine(int x, int y0, int y1, int color)
+/*
+ * The span kernels take logical coordinates, clip them against the clip
+ * rectangle and only then translate to the bits. span() writes the bits of
+ * fill to the pixels x0 to x1 of row y, the byte of fill lining up with each
+ * byte of the row.
+ */
+static void span(surface_t* s, int x0, int x1, int y, uint8_t fill)
 {
-    x  = clip(x, EPD_WIDTH);
-    y0 = clip(y0, EPD_HEIGHT);
-    y1 = clip(y1, EPD_HEIGHT);
+    if (y < s->clip.y0 || y >= s->clip.y1)
+    {
+        return;
+    }
+    order(x0, x1);
+    if (x1 < s->clip.x0 || x0 >= s->clip.x1)
+    {
+        return;
+    }
+    x0 = clamp(x0, s->clip.x0, s->clip.x1 - 1) - s->org_x;
+    x1 = clamp(x1, s->clip.x0, s->clip.x1 - 1) - s->org_x;
+    y -= s->org_y;
+    switch(s->orientation)
+    {
+        case ROTATE_0:
+            spanBits(s->bits + y * s->stride, x0, x1 + 1, fill);
+            break;
+        case ROTATE_180:
+        {
+            // mirrored, bit j of a byte of the bits is logical bit c - j
+            int c = (s->width - 1) & 7;
+            fill = bitrev32(fill) >> 24;
+            fill = (uint8_t)((fill << (7 - c)) | (fill >> (c + 1)));
+            spanBits(s->bits + (s->height - 1 - y) * s->stride, s->width - 1 - x1, s->width - x0, fill);
+            break;
+        }
+        case ROTATE_90:
+        {
+            int bx = s->height - 1 - y;
+            spanColumn(s->bits + x0 * s->stride + (bx >> 3), 0x80 >> (bx & 7), s->stride, x1 - x0 + 1, fill, x0);
+            break;
+        }
+        case ROTATE_270:
+        {
+            int by = s->width - 1 - x0;
+            spanColumn(s->bits + by * s->stride + (y >> 3), 0x80 >> (y & 7), -s->stride, x1 - x0 + 1, fill, x0);
+            break;
+        }
+    }
+}
+
+static void hLine(surface_t* s, int x0, int x1, int y, int color)
+{
+    span(s, x0, x1, y, (color)? 0xff : 0x00);
+}
+
+/* hLine for filled shapes, with the fill pattern of row y */
+static void hFill(surface_t* s, int x0, int x1, int y, int color)
+{
+    uint8_t bits = s->pattern >> ((7 - (y & 7)) * 8);
+    // anchored to logical x, the bytes of a translated surface start at org_x
+    int r = s->org_x & 7;
+    bits = (uint8_t)((bits << r) | (bits >> (8 - r)));
+    span(s, x0, x1, y, (color)? bits : ~bits);
+}
+
+static void vLine(surface_t* s, int x, int y0, int y1, int color)
+{
+    if (x < s->clip.x0 || x >= s->clip.x1)
+    {
+        return;
+    }
     order(y0, y1);
-    uint8_t* p =   framebuffer + y0 * EPD_BYTES_PER_ROW + (x >> 3);
-    uint8_t* end = framebuffer + y1 * EPD_BYTES_PER_ROW + (x >> 3);
-    uint8_t fill = 0x80 >> (x & 0x7);
+    if (y1 < s->clip.y0 || y0 >= s->clip.y1)
+    {
+        return;
+    }
+    y0 = clamp(y0, s->clip.y0, s->clip.y1 - 1);
+    y1 = clamp(y1, s->clip.y0, s->clip.y1 - 1);
+    if (s->orientation != ROTATE_0)
+    {
+        // the ends in the bits, a quarter turn makes it a row
+        int ax = x, ay = y0, bx = x, by = y1;
+        surface_to_bits(s, &ax, &ay);
+        surface_to_bits(s, &bx, &by);
+        order(ax, bx);
+        order(ay, by);
+        if (ay == by)
+        {
+            spanBits(s->bits + ay * s->stride, ax, bx + 1, (color)? 0xff : 0x00);
+        }
+        else
+        {
+            spanColumn(s->bits + ay * s->stride + (ax >> 3), 0x80 >> (ax & 7), s->stride, by - ay + 1, (color)? 0xff : 0x00, 0);
+        }
+        return;
+    }
+    uint8_t* p =   pixel_byte(s, x, y0);
+    uint8_t* end = pixel_byte(s, x, y1);
+    uint8_t fill = 0x80 >> ((x - s->org_x) & 0x7);
     if (color)
     {
         while(p <= end)
         {
             *p |= fill; 
-            p += EPD_BYTES_PER_ROW;
+            p += s->stride;
         }
     }
     else
@@ -92,18 +381,117 @@ static void vLine(int x, int y0, int y1, int color)
         while(p <= end)
         {
             *p &= fill; 
-            p += EPD_BYTES_PER_ROW;
+            p += s->stride;
+        }
+    }
+}
+
+static inline int dash_bit(uint32_t dash, int i)
+{
+    return (dash << (i & 31)) >> 31;
+}
+
+/* pattern bits i to i + 7, most significant first */
+static inline uint8_t dash_byte(uint32_t dash, int i)
+{
+    i &= 31;
+    return (uint8_t)((i? (dash << i) | (dash >> (32 - i)) : dash) >> 24);
+}
+
+/*
+ * hLine with the dash pattern applied a byte at a time; pixel x gets pattern
+ * bit i0 + dir * (x - x0). Needs x0 <= x1. The pattern stays put when the
+ * line is clipped.
+ */
+static void hLineDashed(surface_t* s, int x0, int x1, int y, int color, int i0, int dir)
+{
+    if (y < s->clip.y0 || y >= s->clip.y1)
+    {
+        return;
+    }
+    int b0 = ((x0 < s->clip.x0)? s->clip.x0 : x0) - s->org_x;
+    int b1 = ((x1 >= s->clip.x1)? s->clip.x1 - 1 : x1) - s->org_x;
+    if (b0 > b1)
+    {
+        return;
+    }
+
+    if (s->orientation != ROTATE_0)
+    {
+        for(int x = b0 + s->org_x; x <= b1 + s->org_x; ++x)
+        {
+            if (dash_bit(s->dash, i0 + dir * (x - x0))) pixel(s, x, y, color);
+        }
+        return;
+    }
+
+    // walking left, bit i - k of the pattern is bit 31 - i + k of its mirror image
+    uint32_t dash = (dir > 0)? s->dash : bitrev32(s->dash);
+    uint8_t* row = s->bits + (y - s->org_y) * s->stride;
+    for(int b = b0 >> 3; b <= b1 >> 3; ++b)
+    {
+        int i = i0 + dir * ((b << 3) + s->org_x - x0);
+        uint8_t mask = dash_byte(dash, (dir > 0)? i : 31 - i);
+        if (b == b0 >> 3) mask &= 0xff >> (b0 & 7);
+        if (b == b1 >> 3) mask &= 0xff << (7 - (b1 & 7));
+        uint8_t* p = row + b;
+        set_bitmask(p, mask, color);
+    }
+}
+
+/* vLine with the dash pattern, pixel y gets pattern bit i0 + dir * (y - y0); needs y0 <= y1 */
+static void vLineDashed(surface_t* s, int x, int y0, int y1, int color, int i0, int dir)
+{
+    for(int y = y0; y <= y1; ++y)
+    {
+        if (dash_bit(s->dash, i0 + dir * (y - y0)))
+        {
+            pixel(s, x, y, color);
         }
     }
 }
 
-static void plotLineLow(int x0, int y0, int x1, int y1, int color)
+/*
+ * Returns the dash phase an outline of count pixels starts at and moves the
+ * surface's phase past it. Recording surfaces put the pattern and phase into
+ * the list ahead of the outline, so culled or banded replays stay in step.
+ */
+static int dash_begin(surface_t* s, int count)
+{
+    int phase = s->dash_phase;
+    if (s->list)
+    {
+        const int16_t args[] = { (int16_t)(s->dash >> 16), (int16_t)s->dash, phase };
+        dlist_record(s->list, DL_DASH, INT16_MIN, INT16_MIN, INT16_MAX, INT16_MAX, args, 3, 0);
+    }
+    s->dash_phase = (phase + count) & 31;
+    return phase;
+}
+
+void clear(surface_t* s, int color)
+{
+    const rect_t* c = &s->clip;
+    RECORD(s, DL_CLEAR, c->x0, c->y0, c->x1 - 1, c->y1 - 1, color);
+    surface_mark_dirty(s, c->x0, c->y0, c->x1 - 1, c->y1 - 1);
+    if (c->x0 == s->org_x && c->y0 == s->org_y && c->x1 == s->org_x + s->width && c->y1 == s->org_y + s->height)
+    {
+        int rows = (s->orientation & 1)? s->width : s->height;
+        memset(s->bits, color? 0xff : 0x00, rows * s->stride);
+        return;
+    }
+    for(int y = c->y0; y < c->y1; ++y)
+    {
+        hLine(s, c->x0, c->x1 - 1, y, color);
+    }
+}
+
+static void plotLineLow(surface_t* s, int x0, int y0, int x1, int y1, int color)
 {
   int dx = x1 - x0;
   int dy = y1 - y0;
   if (dy == 0)
   {
-      hLine(x0, x1, y0, color);
+      hLine(s, x0, x1, y0, color);
       return;
   }
   int yi = 1;
@@ -117,7 +505,7 @@ static void plotLineLow(int x0, int y0, int x1, int y1, int color)
 
   for(int x = x0; x < x1; ++x)
   {
-    set_pixel(x, y, color);
+    pixel(s, x, y, color);
     if (D > 0) 
     {
        y = y + yi;
@@ -127,12 +515,12 @@ static void plotLineLow(int x0, int y0, int x1, int y1, int color)
   }
 }
 
-static void plotLineHigh(int x0, int y0, int x1, int y1, int color)
+static void plotLineHigh(surface_t* s, int x0, int y0, int x1, int y1, int color)
 {
   int dx = x1 - x0;
   if (dx == 0)
   {
-      vLine(x0, y0, y1, color);
+      vLine(s, x0, y0, y1, color);
       return;
   }
   int dy = y1 - y0;
@@ -148,7 +536,7 @@ static void plotLineHigh(int x0, int y0, int x1, int y1, int color)
 
   for(int y = y0; y < y1; ++y)
   {
-    set_pixel(x, y, color);
+    pixel(s, x, y, color);
     if (D > 0)
     {
        x = x + xi;
@@ -158,156 +546,904 @@ static void plotLineHigh(int x0, int y0, int x1, int y1, int color)
   }
 }
 
-static void dCircle(int xc, int yc, int x, int y, int color) 
-{ 
-    set_pixel(xc+x, yc+y, color); 
-    set_pixel(xc-x, yc+y, color); 
-    set_pixel(xc+x, yc-y, color); 
-    set_pixel(xc-x, yc-y, color); 
-    set_pixel(xc+y, yc+x, color); 
-    set_pixel(xc-y, yc+x, color); 
-    set_pixel(xc+y, yc-x, color); 
-    set_pixel(xc-y, yc-x, color); 
+/* plotLineLow and plotLineHigh with the dash pattern, pixel k gets bit i0 + dir * k */
+static void dashLineLow(surface_t* s, int x0, int y0, int x1, int y1, int color, int i0, int dir)
+{
+    int dx = x1 - x0;
+    int dy = y1 - y0;
+    if (dy == 0)
+    {
+        hLineDashed(s, x0, x1, y0, color, i0, dir);
+        return;
+    }
+    int yi = 1;
+    if (dy < 0)
+    {
+        yi = -1;
+        dy = -dy;
+    }
+    int D = 2*dy - dx;
+    int y = y0;
+
+    for(int x = x0; x < x1; ++x, i0 += dir)
+    {
+        if (dash_bit(s->dash, i0)) pixel(s, x, y, color);
+        if (D > 0)
+        {
+            y = y + yi;
+            D = D - 2*dx;
+        }
+        D = D + 2*dy;
+    }
 }
 
-static void dFilledCircle(int xc, int yc, int x, int y, int color) 
+static void dashLineHigh(surface_t* s, int x0, int y0, int x1, int y1, int color, int i0, int dir)
+{
+    int dx = x1 - x0;
+    if (dx == 0)
+    {
+        vLineDashed(s, x0, y0, y1, color, i0, dir);
+        return;
+    }
+    int dy = y1 - y0;
+    int xi = 1;
+    if (dx < 0)
+    {
+        xi = -1;
+        dx = -dx;
+    }
+    int D = 2*dx - dy;
+    int x = x0;
+
+    for(int y = y0; y < y1; ++y, i0 += dir)
+    {
+        if (dash_bit(s->dash, i0)) pixel(s, x, y, color);
+        if (D > 0)
+        {
+            x = x + xi;
+            D = D - 2*dy;
+        }
+        D = D + 2*dx;
+    }
+}
+
+static void dCircle(surface_t* s, int xc, int yc, int x, int y, int color)
 { 
-    hLine(xc-x, xc+x, yc+y, color); 
-    hLine(xc-x, xc+x, yc-y, color); 
-    hLine(xc-y, xc+y, yc+x, color); 
-    hLine(xc-y, xc+y, yc-x, color); 
+    pixel(s, xc+x, yc+y, color);
+    pixel(s, xc-x, yc+y, color);
+    pixel(s, xc+x, yc-y, color);
+    pixel(s, xc-x, yc-y, color);
+    pixel(s, xc+y, yc+x, color);
+    pixel(s, xc-y, yc+x, color);
+    pixel(s, xc+y, yc-x, color);
+    pixel(s, xc-y, yc-x, color);
+}
+
+#define plot(row, x, color) set_bitmask(((row) + ((x) >> 3)), (0x80 >> ((x) & 0x7)), color)
+
+/*
+ * Same octant mirroring as dCircle for circles that are known to lie entirely
+ * inside the clip rectangle: no bounds checks, and the four rows are addressed
+ * only once. Unlike the other kernels this one takes coordinates relative to
+ * the bits.
+ */
+static void dCircleUnclipped(surface_t* s, int xc, int yc, int x, int y, int color)
+{
+    uint8_t* below = s->bits + (yc + y) * s->stride;
+    uint8_t* above = s->bits + (yc - y) * s->stride;
+    plot(below, xc + x, color);
+    plot(below, xc - x, color);
+    plot(above, xc + x, color);
+    plot(above, xc - x, color);
+
+    below = s->bits + (yc + x) * s->stride;
+    above = s->bits + (yc - x) * s->stride;
+    plot(below, xc + y, color);
+    plot(below, xc - y, color);
+    plot(above, xc + y, color);
+    plot(above, xc - y, color);
+}
+
+/*
+ * The octants in clockwise order from 3 o'clock: whether x and y swap, the
+ * signs, and whether the walk runs against the clock there.
+ */
+static const int8_t octants[8][4] =
+{
+    { 1,  1,  1, 0 }, { 0,  1,  1, 1 }, { 0, -1,  1, 0 }, { 1, -1,  1, 1 },
+    { 1, -1, -1, 0 }, { 0, -1, -1, 1 }, { 0,  1, -1, 0 }, { 1,  1, -1, 1 }
+};
+
+/* dCircle for step k of n with the dash pattern running clockwise from i0 */
+static void dCircleDashed(surface_t* s, int xc, int yc, int x, int y, int k, int n, int i0, int color)
+{
+    for(int o = 0; o < 8; ++o)
+    {
+        const int8_t* oct = octants[o];
+        int i = i0 + o * n + (oct[3]? n - 1 - k : k);
+        if (dash_bit(s->dash, i))
+        {
+            int dx = oct[0]? y : x, dy = oct[0]? x : y;
+            pixel(s, xc + oct[1] * dx, yc + oct[2] * dy, color);
+        }
+    }
+}
+
+/*
+ * Midpoint walk over the first octant of a circle of radius r > 0, running
+ * plot8 (which mirrors x, y into all eight octants) for every step.
+ */
+#define CIRCLE_WALK(r, plot8) \
+    { \
+        int x = 0, y = r; \
+        int d = 3 - 2 * r; \
+        plot8; \
+        while (y >= x) \
+        { \
+            x++; \
+            if (d > 0) \
+            { \
+                y--; \
+                d = d + 4 * (x - y) + 10; \
+            } \
+            else \
+                d = d + 4 * x + 6; \
+            plot8; \
+        } \
+    }
+
+/*
+ * Span generator for ellipse quadrants: walks the rows dy = 0, 1, ..., b and
+ * yields the half-width of each row. Circles (a == b) take their rows from
+ * the same midpoint walk as draw_circle(), so a filled circle covers exactly
+ * its outline and what lies inside. The walk runs in octant order, its rows
+ * are collected SPAN_ROWS at a time. Other ellipses use the ellipse through
+ * the pixel edges, (x / (a + 1/2))^2 + (y / (b + 1/2))^2 <= 1. Rows must be
+ * requested in increasing order.
+ */
+#define SPAN_ROWS 32
+
+typedef struct
+{
+    int64_t aa;     // (2a + 1)^2
+    int64_t bb;     // (2b + 1)^2
+    int64_t aabb;
+    int dx;
+    int r;          // radius of a circle, -1 for other ellipses
+    int base;       // the first row held in row[]
+    int16_t row[SPAN_ROWS];
+} span_gen_t;
+
+static void span_gen_init(span_gen_t* g, int a, int b)
+{
+    g->aa = (int64_t)(2 * a + 1) * (2 * a + 1);
+    g->bb = (int64_t)(2 * b + 1) * (2 * b + 1);
+    g->aabb = g->aa * g->bb;
+    g->dx = a;
+    g->r = (a == b)? a : -1;
+    g->base = -SPAN_ROWS;
+}
+
+/* widens row dy to reach dx, if it is one of those held */
+static inline void span_row(span_gen_t* g, int dy, int dx)
+{
+    int i = dy - g->base;
+    if (dx >= 0 && i >= 0 && i < SPAN_ROWS && g->row[i] < dx)
+    {
+        g->row[i] = dx;
+    }
+}
+
+static void span_gen_fill(span_gen_t* g, int base)
+{
+    g->base = base;
+    for(int i = 0; i < SPAN_ROWS; ++i)
+    {
+        g->row[i] = -1;
+    }
+    if (g->r == 0)
+    {
+        g->row[0] = (base == 0)? 0 : -1;
+        return;
+    }
+    // an outline point (x, y) bounds rows y and x, like the octants of draw_circle()
+    CIRCLE_WALK(g->r, (span_row(g, y, x), span_row(g, x, y)));
+}
+
+static int span_gen_next(span_gen_t* g, int dy)
+{
+    if (g->r >= 0)
+    {
+        if (dy >= g->base + SPAN_ROWS)
+        {
+            span_gen_fill(g, dy);
+        }
+        return g->row[dy - g->base];
+    }
+    int64_t yy = 4 * g->aa * dy * dy;
+    while (g->dx > 0 && 4 * g->bb * g->dx * g->dx + yy > g->aabb)
+    {
+        --g->dx;
+    }
+    return g->dx;
+}
+
+/*
+ * Fills the rounded box whose straight edges run from xl to xr and yt to yb
+ * and whose corners are the quadrants of an a by b ellipse. Every scanline is
+ * emitted exactly once. A point (xl == xr, yt == yb) gives a filled ellipse,
+ * a == b == 0 gives a plain rectangle.
+ */
+static void fill_rounded_box(surface_t* s, int xl, int yt, int xr, int yb, int a, int b, int color)
+{
+    span_gen_t g;
+    span_gen_init(&g, a, b);
+    span_gen_next(&g, 0);
+    for(int y = yt; y <= yb; ++y)
+    {
+        hFill(s, xl - a, xr + a, y, color);
+    }
+    for(int dy = 1; dy <= b; ++dy)
+    {
+        int dx = span_gen_next(&g, dy);
+        hFill(s, xl - dx, xr + dx, yt - dy, color);
+        hFill(s, xl - dx, xr + dx, yb + dy, color);
+    }
 }
 
-void draw_line(int x0, int y0, int x1, int y1, int color)
+void draw_line(surface_t* s, int x0, int y0, int x1, int y1, int color)
 {
+    int dashed = s->dash != DASH_SOLID;
+    int phase = 0, count = 0;
+    if (dashed)
+    {
+        // the plotLine loops leave out their end point, straight lines do not
+        int dx = abs(x1 - x0), dy = abs(y1 - y0);
+        count = (dx == 0 || dy == 0)? dx + dy + 1 : (dx > dy)? dx : dy;
+        phase = dash_begin(s, count);
+    }
+    RECORD(s, DL_LINE, x0, y0, x1, y1, x0, y0, x1, y1, color);
+    surface_mark_dirty(s, x0, y0, x1, y1);
+    if (dashed)
+    {
+        // the pattern runs from (x0, y0), also when the kernels start at the other end
+        int last = phase + count - 1;
+        if (abs(y1 - y0) < abs(x1 - x0))
+        {
+            if (x0 > x1)
+                dashLineLow(s, x1, y1, x0, y0, color, last, -1);
+            else
+                dashLineLow(s, x0, y0, x1, y1, color, phase, 1);
+        }
+        else
+        {
+            if (y0 > y1)
+                dashLineHigh(s, x1, y1, x0, y0, color, last, -1);
+            else
+                dashLineHigh(s, x0, y0, x1, y1, color, phase, 1);
+        }
+        return;
+    }
     if (abs(y1 - y0) < abs(x1 - x0))
     {
         if (x0 > x1)
         {
-            plotLineLow(x1, y1, x0, y0, color);
+            plotLineLow(s, x1, y1, x0, y0, color);
         }
         else
         {
-            plotLineLow(x0, y0, x1, y1, color);
+            plotLineLow(s, x0, y0, x1, y1, color);
         }
     }
     else
     {
         if (y0 > y1)
         {
-            plotLineHigh(x1, y1, x0, y0, color);
+            plotLineHigh(s, x1, y1, x0, y0, color);
         }
         else
         {
-            plotLineHigh(x0, y0, x1, y1, color);
+            plotLineHigh(s, x0, y0, x1, y1, color);
         }
     }
 }
 
-void draw_circle(int xc, int yc, int r, int color) 
+void draw_circle(surface_t* s, int xc, int yc, int r, int color)
 { 
-    int x = 0, y = r; 
-    int d = 3 - 2 * r; 
-    dCircle(xc, yc, x, y, color); 
-    while (y >= x) 
-    { 
-        x++; 
-        if (d > 0) 
-        { 
-            y--;  
-            d = d + 4 * (x - y) + 10; 
-        } 
-        else
-            d = d + 4 * x + 6; 
-        dCircle(xc, yc, x, y, color); 
-    } 
+    if (r < 0)
+    {
+        return;
+    }
+    int n = 0, phase = 0;
+    if (s->dash != DASH_SOLID)
+    {
+        if (r > 0) CIRCLE_WALK(r, ++n);
+        phase = dash_begin(s, (r > 0)? 8 * n : 1);
+    }
+    RECORD(s, DL_CIRCLE, xc - r, yc - r, xc + r, yc + r, xc, yc, r, color);
+    const rect_t* c = &s->clip;
+    if (xc + r < c->x0 || xc - r >= c->x1 || yc + r < c->y0 || yc - r >= c->y1)
+    {
+        return;
+    }
+    surface_mark_dirty(s, xc - r, yc - r, xc + r, yc + r);
+    if (r == 0)
+    {
+        // the octant walk below would overshoot onto the diagonal neighbours
+        if (dash_bit(s->dash, phase)) pixel(s, xc, yc, color);
+        return;
+    }
+    if (s->dash != DASH_SOLID)
+    {
+        int k = 0;
+        CIRCLE_WALK(r, dCircleDashed(s, xc, yc, x, y, k++, n, phase, color));
+        return;
+    }
+
+    // only circles crossing the border need per-pixel clipping
+    void (*octants)(surface_t*, int, int, int, int, int) = dCircle;
+    if (xc - r >= c->x0 && xc + r < c->x1 && yc - r >= c->y0 && yc + r < c->y1)
+    {
+        // the pixels of a circle are the same in every orientation
+        octants = dCircleUnclipped;
+        surface_to_bits(s, &xc, &yc);
+    }
+
+    CIRCLE_WALK(r, octants(s, xc, yc, x, y, color));
 } 
 
-void draw_filled_circle(int xc, int yc, int r, int color) 
+void draw_filled_circle(surface_t* s, int xc, int yc, int r, int color)
 { 
-    int x = 0, y = r; 
-    int d = 3 - 2 * r; 
-    dFilledCircle(xc, yc, x, y, color); 
-    while (y >= x) 
-    { 
-        x++; 
-        if (d > 0) 
-        { 
-            y--;  
-            d = d + 4 * (x - y) + 10; 
-        } 
-        else
-            d = d + 4 * x + 6; 
-        dFilledCircle(xc, yc, x, y, color); 
-    } 
+    if (r < 0)
+    {
+        return;
+    }
+    RECORD(s, DL_FILLED_CIRCLE, xc - r, yc - r, xc + r, yc + r, xc, yc, r, color);
+    surface_mark_dirty(s, xc - r, yc - r, xc + r, yc + r);
+    fill_rounded_box(s, xc, yc, xc, yc, r, r, color);
 } 
 
-void draw_filled_rect(int x0, int y0, int x1, int y1, int color)
+void draw_filled_ellipse(surface_t* s, int xc, int yc, int a, int b, int color)
+{
+    if (a < 0 || b < 0)
+    {
+        return;
+    }
+    RECORD(s, DL_FILLED_ELLIPSE, xc - a, yc - b, xc + a, yc + b, xc, yc, a, b, color);
+    surface_mark_dirty(s, xc - a, yc - b, xc + a, yc + b);
+    fill_rounded_box(s, xc, yc, xc, yc, a, b, color);
+}
+
+void draw_filled_rect(surface_t* s, int x0, int y0, int x1, int y1, int color)
 {
     order(y0, y1);
+    if (y0 == y1)
+    {
+        return;
+    }
+    RECORD(s, DL_FILLED_RECT, x0, y0, x1, y1 - 1, x0, y0, x1, y1, color);
+    surface_mark_dirty(s, x0, y0, x1, y1 - 1);
     while(y0 < y1)
     {
-        hLine(x0, x1, y0, color);
+        hFill(s, x0, x1, y0, color);
         ++y0;
     }
 }
 
-void draw_rect(int x0, int y0, int x1, int y1, int color)
+/* the outline of a rectangle clockwise from its top left corner, each pixel once */
+static void dashRect(surface_t* s, int x0, int y0, int x1, int y1, int color, int i)
 {
-    vLine(x0, y0, y1, color);
-    vLine(x1, y0, y1, color);
-    hLine(x0, x1, y0, color);
-    hLine(x0, x1, y1, color);
+    int w = x1 - x0, h = y1 - y0;
+    if (w == 0 || h == 0)
+    {
+        hLineDashed(s, x0, x1, y0, color, i, 1);
+        if (w == 0 && h > 0) vLineDashed(s, x0, y0 + 1, y1, color, i + 1, 1);
+        return;
+    }
+    hLineDashed(s, x0, x1, y0, color, i, 1);
+    vLineDashed(s, x1, y0 + 1, y1, color, i + w + 1, 1);
+    hLineDashed(s, x0, x1 - 1, y1, color, i + 2 * w + h, -1);
+    if (h > 1) vLineDashed(s, x0, y0 + 1, y1 - 1, color, i + 2 * w + 2 * h - 1, -1);
 }
 
-int draw_glyph(uint8_t ch, int x0, int y0, int color, const lv_font_t* font_p)
+void draw_rect(surface_t* s, int x0, int y0, int x1, int y1, int color)
 {
-    int fontWidth = lv_font_get_width(font_p, ch);
-    if (fontWidth < 0)
+    if (s->dash != DASH_SOLID)
     {
-        return x0;
+        order(x0, x1);
+        order(y0, y1);
+        int w = x1 - x0, h = y1 - y0;
+        int count = (w == 0 || h == 0)? w + h + 1 : 2 * (w + h);
+        int phase = dash_begin(s, count);
+        RECORD(s, DL_RECT, x0, y0, x1, y1, x0, y0, x1, y1, color);
+        surface_mark_dirty(s, x0, y0, x1, y1);
+        dashRect(s, x0, y0, x1, y1, color, phase);
+        return;
     }
-    int fontHeight = font_p->h_px;
+    RECORD(s, DL_RECT, x0, y0, x1, y1, x0, y0, x1, y1, color);
+    surface_mark_dirty(s, x0, y0, x1, y1);
+    vLine(s, x0, y0, y1, color);
+    vLine(s, x1, y0, y1, color);
+    hLine(s, x0, x1, y0, color);
+    hLine(s, x0, x1, y1, color);
+}
+
+/*
+ * A polygon edge while it crosses the scanlines y0 <= y < y1. Its crossing
+ * with the centre line of the current row is kept exactly as xi + err / den;
+ * col is the first pixel whose centre lies right of it.
+ */
+typedef struct
+{
+    int32_t xi;
+    int32_t err;
+    int32_t q;
+    int32_t r;
+    int32_t den;
+    int32_t col;
+    int16_t y0;
+    int16_t y1;
+    int16_t dir;
+} edge_t;
+
+static int edge_cmp(const void* a, const void* b)
+{
+    return ((const edge_t*)a)->y0 - ((const edge_t*)b)->y0;
+}
 
-    if (x0 + fontWidth >= 0)
+static int edge_init(edge_t* e, point_t a, point_t b, const rect_t* clip)
+{
+    e->dir = 1;
+    if (a.y > b.y)
+    {
+        point_t t = a; a = b; b = t;
+        e->dir = -1;
+    }
+    e->y0 = a.y < clip->y0? clip->y0 : a.y;
+    e->y1 = b.y > clip->y1? clip->y1 : b.y;
+    if (e->y0 >= e->y1)
     {
-        y0 = clip(y0, EPD_HEIGHT);
+        return 0;
+    }
+
+    // x = a.x + (2 * (y - a.y) + 1) * dx / (2 * dy) at the centre of row y
+    int32_t dx = b.x - a.x, dy = b.y - a.y;
+    int64_t num = (int64_t)(2 * (e->y0 - a.y) + 1) * dx;
+    e->den = 2 * dy;
+    int64_t q = num / e->den;
+    if (q * e->den > num) --q;
+    e->xi = a.x + q;
+    e->err = num - q * e->den;
+    e->q = dx / dy;
+    if (e->q * dy > dx) --e->q;
+    e->r = 2 * (dx - e->q * dy);
+    e->col = e->xi + (2 * e->err > e->den);
+    return 1;
+}
+
+static void edge_step(edge_t* e)
+{
+    e->xi += e->q;
+    e->err += e->r;
+    if (e->err >= e->den)
+    {
+        e->err -= e->den;
+        ++e->xi;
+    }
+    e->col = e->xi + (2 * e->err > e->den);
+}
 
-        const uint8_t* glyph = lv_font_get_bitmap(font_p, ch);
-        uint8_t* p = framebuffer + EPD_BYTES_PER_ROW*y0 + (x0 >> 3);
-        int shift = 8 - (x0 & 0x7);
-        for(int i = 0; i < fontHeight; ++i)
+void draw_filled_polygons(surface_t* s, const point_t* pts, const int16_t* counts, int ncontours, fill_rule_t rule, int color)
+{
+    int total = 0;
+    for(int c = 0; c < ncontours; ++c)
+    {
+        total += counts[c];
+    }
+    if (total <= 0)
+    {
+        return;
+    }
+    int x0 = pts[0].x, y0 = pts[0].y, x1 = x0, y1 = y0;
+    for(int i = 1; i < total; ++i)
+    {
+        if (pts[i].x < x0) x0 = pts[i].x;
+        if (pts[i].x > x1) x1 = pts[i].x;
+        if (pts[i].y < y0) y0 = pts[i].y;
+        if (pts[i].y > y1) y1 = pts[i].y;
+    }
+
+    if (s->list)
+    {
+        const int16_t args[] = { ncontours, rule, color };
+        uint8_t* payload = dlist_record(s->list, DL_FILLED_POLYGON, x0, y0, x1, y1, args, 3,
+                                        ncontours * sizeof(int16_t) + total * sizeof(point_t));
+        if (payload)
+        {
+            memcpy(payload, counts, ncontours * sizeof(int16_t));
+            memcpy(payload + ncontours * sizeof(int16_t), pts, total * sizeof(point_t));
+        }
+        return;
+    }
+    surface_mark_dirty(s, x0, y0, x1, y1);
+
+    // the edge table and the active edge list, allocated once per polygon
+    edge_t* edges = (edge_t*)malloc(total * (sizeof(edge_t) + sizeof(edge_t*)));
+    if (edges == NULL)
+    {
+        return;
+    }
+    edge_t** active = (edge_t**)(edges + total);
+
+    int nedges = 0;
+    const point_t* first = pts;
+    for(int c = 0; c < ncontours; ++c)
+    {
+        for(int i = 0; i < counts[c]; ++i)
         {
-            if (y0 + i >= EPD_HEIGHT) break;
-            
-            uint8_t* dest = p + EPD_BYTES_PER_ROW*i;
-            int stride = (fontWidth + 7) >> 3;
-            int x = x0;
-            for(int j = 0; j < stride; ++j)
+            point_t b = first[(i + 1 < counts[c])? i + 1 : 0];
+            nedges += edge_init(&edges[nedges], first[i], b, &s->clip);
+        }
+        first += counts[c];
+    }
+    qsort(edges, nedges, sizeof(edge_t), edge_cmp);
+
+    int next = 0, nactive = 0, y = 0;
+    while(next < nedges || nactive)
+    {
+        if (nactive == 0)
+        {
+            y = edges[next].y0;
+        }
+        while(next < nedges && edges[next].y0 == y)
+        {
+            active[nactive++] = &edges[next++];
+        }
+
+        // the order changes little from one row to the next
+        for(int i = 1; i < nactive; ++i)
+        {
+            edge_t* e = active[i];
+            int j = i;
+            for(; j > 0 && active[j - 1]->col > e->col; --j)
+            {
+                active[j] = active[j - 1];
+            }
+            active[j] = e;
+        }
+
+        if (rule == FILL_EVEN_ODD)
+        {
+            for(int i = 0; i + 1 < nactive; i += 2)
             {
-                uint16_t bits = glyph[i*stride + j] << shift;
-                uint8_t hiByte = (bits >> 8) & 0xff;
-                if (hiByte && x >= 0)
+                if (active[i]->col < active[i + 1]->col)
                 {
-                    set_bitmask(dest, hiByte, color);
+                    hFill(s, active[i]->col, active[i + 1]->col - 1, y, color);
                 }
-                ++dest;
-                x += 8;
-                uint8_t loByte = (bits & 0xff);
-                if (loByte && x >= 0 && x < EPD_WIDTH)
+            }
+        }
+        else
+        {
+            int winding = 0, start = 0;
+            for(int i = 0; i < nactive; ++i)
+            {
+                if (winding == 0)
+                {
+                    start = active[i]->col;
+                }
+                winding += active[i]->dir;
+                if (winding == 0 && start < active[i]->col)
                 {
-                    set_bitmask(dest, loByte, color);
+                    hFill(s, start, active[i]->col - 1, y, color);
                 }
             }
         }
+
+        ++y;
+        int k = 0;
+        for(int i = 0; i < nactive; ++i)
+        {
+            if (active[i]->y1 > y)
+            {
+                edge_step(active[i]);
+                active[k++] = active[i];
+            }
+        }
+        nactive = k;
+    }
+
+    free(edges);
+}
+
+void draw_filled_polygon(surface_t* s, const point_t* pts, int n, fill_rule_t rule, int color)
+{
+    const int16_t counts[] = { n };
+    draw_filled_polygons(s, pts, counts, 1, rule, color);
+}
+
+/* the octants of a circle split at the centres of a rounded box's corners */
+static void dRoundCorners(surface_t* s, int xl, int yt, int xr, int yb, int x, int y, int color)
+{
+    pixel(s, xr + x, yb + y, color);
+    pixel(s, xl - x, yb + y, color);
+    pixel(s, xr + x, yt - y, color);
+    pixel(s, xl - x, yt - y, color);
+    pixel(s, xr + y, yb + x, color);
+    pixel(s, xl - y, yb + x, color);
+    pixel(s, xr + y, yt - x, color);
+    pixel(s, xl - y, yt - x, color);
+}
+
+/* orders the corners and limits r to what fits the rectangle */
+static int round_rect_radius(int* x0, int* y0, int* x1, int* y1, int r)
+{
+    order(*x0, *x1);
+    order(*y0, *y1);
+    if (r > (*x1 - *x0) / 2) r = (*x1 - *x0) / 2;
+    if (r > (*y1 - *y0) / 2) r = (*y1 - *y0) / 2;
+    return (r < 0)? 0 : r;
+}
+
+void draw_round_rect(surface_t* s, int x0, int y0, int x1, int y1, int r, int color)
+{
+    RECORD(s, DL_ROUND_RECT, x0, y0, x1, y1, x0, y0, x1, y1, r, color);
+    r = round_rect_radius(&x0, &y0, &x1, &y1, r);
+    surface_mark_dirty(s, x0, y0, x1, y1);
+    hLine(s, x0 + r, x1 - r, y0, color);
+    hLine(s, x0 + r, x1 - r, y1, color);
+    vLine(s, x0, y0 + r, y1 - r, color);
+    vLine(s, x1, y0 + r, y1 - r, color);
+    if (r > 0)
+    {
+        int xl = x0 + r, yt = y0 + r, xr = x1 - r, yb = y1 - r;
+        CIRCLE_WALK(r, dRoundCorners(s, xl, yt, xr, yb, x, y, color));
+    }
+}
+
+void draw_filled_round_rect(surface_t* s, int x0, int y0, int x1, int y1, int r, int color)
+{
+    RECORD(s, DL_FILLED_ROUND_RECT, x0, y0, x1, y1, x0, y0, x1, y1, r, color);
+    r = round_rect_radius(&x0, &y0, &x1, &y1, r);
+    surface_mark_dirty(s, x0, y0, x1, y1);
+    fill_rounded_box(s, x0 + r, y0 + r, x1 - r, y1 - r, r, r, color);
+}
+
+/*
+ * The sweep from angle start clockwise to angle end, as the directions of
+ * its two bounding rays in Q14. Whether a point lies inside is decided by
+ * the signs of two cross products, without any trigonometry per pixel.
+ */
+typedef struct
+{
+    int32_t sx, sy;
+    int32_t ex, ey;
+    int span;               // degrees swept, 360 for a full circle
+} sweep_t;
+
+static int sweep_init(sweep_t* w, int start, int end)
+{
+    w->span = (end - start >= 360 || start - end >= 360)? 360 : ((end - start) % 360 + 360) % 360;
+    w->sx = icos(start);
+    w->sy = isin(start);
+    w->ex = icos(end);
+    w->ey = isin(end);
+    return w->span > 0;
+}
+
+/* clockwise of the start ray: s x p >= 0, anticlockwise of the end ray: e x p <= 0 */
+static int in_sweep(const sweep_t* w, int dx, int dy)
+{
+    if (w->span >= 360)
+    {
+        return 1;
+    }
+    int after_start = (int64_t)w->sx * dy - (int64_t)w->sy * dx >= 0;
+    int before_end = (int64_t)w->ex * dy - (int64_t)w->ey * dx <= 0;
+    return (w->span <= 180)? after_start && before_end : after_start || before_end;
+}
+
+static void dArc(surface_t* s, int xc, int yc, const sweep_t* w, int x, int y, int color)
+{
+    const int8_t sign[4][2] = { { 1, 1 }, { -1, 1 }, { 1, -1 }, { -1, -1 } };
+    for(int i = 0; i < 4; ++i)
+    {
+        int dx = sign[i][0] * x, dy = sign[i][1] * y;
+        if (in_sweep(w, dx, dy)) pixel(s, xc + dx, yc + dy, color);
+        if (in_sweep(w, dy, dx)) pixel(s, xc + dy, yc + dx, color);
+    }
+}
+
+void draw_arc(surface_t* s, int xc, int yc, int r, int start, int end, int color)
+{
+    sweep_t w;
+    if (r < 0 || !sweep_init(&w, start, end))
+    {
+        return;
+    }
+    RECORD(s, DL_ARC, xc - r, yc - r, xc + r, yc + r, xc, yc, r, start, end, color);
+    surface_mark_dirty(s, xc - r, yc - r, xc + r, yc + r);
+    if (r == 0)
+    {
+        pixel(s, xc, yc, color);
+        return;
+    }
+    CIRCLE_WALK(r, dArc(s, xc, yc, &w, x, y, color));
+}
+
+static int floor_div(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0))? q - 1 : q;
+}
+
+static int ceil_div(int64_t a, int64_t b)
+{
+    return -floor_div(-a, b);
+}
+
+/*
+ * The dx of row dy on the inner side of the ray through (rx, ry): clockwise
+ * of it for side > 0, anticlockwise for side < 0. Returns 0 if no dx is.
+ */
+static int ray_side(int32_t rx, int32_t ry, int dy, int side, int* lo, int* hi)
+{
+    // side * (rx * dy - ry * dx) >= 0
+    int64_t c = (int64_t)rx * dy * side;
+    int64_t k = (int64_t)ry * side;
+    *lo = INT16_MIN;
+    *hi = INT16_MAX;
+    if (k == 0)
+    {
+        return c >= 0;
+    }
+    if (k > 0)
+    {
+        *hi = floor_div(c, k);
+    }
+    else
+    {
+        *lo = ceil_div(c, k);
+    }
+    return 1;
+}
+
+/* the part of the span xl..xr of row dy that lies in the sweep, each pixel once */
+static void sweep_span(surface_t* s, int xc, int y, const sweep_t* w, int dy, int xl, int xr, int color)
+{
+    if (w->span >= 360)
+    {
+        hFill(s, xc + xl, xc + xr, y, color);
+        return;
+    }
+    int lo[2], hi[2];
+    int in[2] = { ray_side(w->sx, w->sy, dy, 1, &lo[0], &hi[0]), ray_side(w->ex, w->ey, dy, -1, &lo[1], &hi[1]) };
+    if (w->span <= 180)
+    {
+        if (!in[0] || !in[1]) return;
+        int a = (lo[0] > lo[1])? lo[0] : lo[1];
+        int b = (hi[0] < hi[1])? hi[0] : hi[1];
+        if (a < xl) a = xl;
+        if (b > xr) b = xr;
+        if (a <= b) hFill(s, xc + a, xc + b, y, color);
+        return;
+    }
+
+    // more than half a turn: the union of both sides, merged where they meet
+    int n = 0, a[2], b[2];
+    for(int i = 0; i < 2; ++i)
+    {
+        int l = (lo[i] > xl)? lo[i] : xl, h = (hi[i] < xr)? hi[i] : xr;
+        if (in[i] && l <= h)
+        {
+            a[n] = l;
+            b[n++] = h;
+        }
+    }
+    if (n == 2 && a[1] <= b[0] + 1 && a[0] <= b[1] + 1)
+    {
+        a[0] = (a[0] < a[1])? a[0] : a[1];
+        b[0] = (b[0] > b[1])? b[0] : b[1];
+        n = 1;
+    }
+    for(int i = 0; i < n; ++i)
+    {
+        hFill(s, xc + a[i], xc + b[i], y, color);
+    }
+}
+
+void draw_filled_arc(surface_t* s, int xc, int yc, int r0, int r1, int start, int end, int color)
+{
+    sweep_t w;
+    if (r0 < 0) r0 = 0;
+    if (r1 < r0 || !sweep_init(&w, start, end))
+    {
+        return;
+    }
+    RECORD(s, DL_FILLED_ARC, xc - r1, yc - r1, xc + r1, yc + r1, xc, yc, r0, r1, start, end, color);
+    surface_mark_dirty(s, xc - r1, yc - r1, xc + r1, yc + r1);
+
+    // the disc of radius r1 without the disc of radius r0 - 1, row by row
+    span_gen_t outer, inner;
+    span_gen_init(&outer, r1, r1);
+    span_gen_init(&inner, r0 - 1, r0 - 1);
+    for(int dy = 0; dy <= r1; ++dy)
+    {
+        int wo = span_gen_next(&outer, dy);
+        int wi = (dy < r0)? span_gen_next(&inner, dy) : -1;
+        for(int side = (dy == 0)? 1 : -1; side <= 1; side += 2)
+        {
+            int y = yc + side * dy;
+            if (y < s->clip.y0 || y >= s->clip.y1)
+            {
+                continue;
+            }
+            if (wi < 0)
+            {
+                sweep_span(s, xc, y, &w, side * dy, -wo, wo, color);
+            }
+            else
+            {
+                sweep_span(s, xc, y, &w, side * dy, -wo, -wi - 1, color);
+                sweep_span(s, xc, y, &w, side * dy, wi + 1, wo, color);
+            }
+        }
+    }
+}
+
+void draw_pie(surface_t* s, int xc, int yc, int r, int start, int end, int color)
+{
+    draw_filled_arc(s, xc, yc, 0, r, start, end, color);
+}
+
+static int draw_glyph(surface_t* s, uint8_t ch, int x0, int y0, int color, const lv_font_t* font_p)
+{
+    int fontWidth = lv_font_get_width(font_p, ch);
+    const uint8_t* glyph = lv_font_get_bitmap(font_p, ch);
+    if (fontWidth <= 0 || glyph == NULL)
+    {
+        return x0;
     }
+
+    // glyph bits mark ink, so white text sets them and black text clears them
+    bitmap_t bitmap = { glyph, fontWidth, font_p->h_px, (fontWidth + 7) >> 3 };
+    blit(s, x0, y0, &bitmap, 0, 0, bitmap.width, bitmap.height, color? ROP_OR : ROP_ANDNOT);
     return x0 + fontWidth;
 }
 
-void draw_text(const char* text, int x0, int y0, int color, const lv_font_t * font_p, int xoff, int yoff)
+void draw_text(surface_t* s, const char* text, int x0, int y0, int color, const lv_font_t * font_p, int xoff, int yoff)
 {
-    for(const uint8_t* pc = (const uint8_t*)text; *pc && x0 < EPD_WIDTH; pc++)
+    if (s->list)
+    {
+        int x1 = x0;
+        for(const uint8_t* pc = (const uint8_t*)text; *pc; pc++)
+        {
+            x1 += lv_font_get_width(font_p, *pc) + xoff;
+        }
+        int length = strlen(text) + 1;
+        const int16_t args[] = { x0, y0, color, xoff, yoff };
+        uint8_t* payload = dlist_record(s->list, DL_TEXT, x0, y0, x1 - 1, y0 + font_p->h_px - 1,
+                                        args, sizeof(args) / sizeof(args[0]), sizeof(font_p) + length);
+        if (payload)
+        {
+            memcpy(payload, &font_p, sizeof(font_p));
+            memcpy(payload + sizeof(font_p), text, length);
+        }
+        return;
+    }
+
+    // mark the whole line up front, the per-glyph blits then fall inside it
+    int x1 = x0;
+    for(const uint8_t* pc = (const uint8_t*)text; *pc && x1 < s->clip.x1; pc++)
+    {
+        x1 += lv_font_get_width(font_p, *pc) + xoff;
+    }
+    if (x1 > x0)
+    {
+        surface_mark_dirty(s, x0, y0, x1 - 1, y0 + font_p->h_px - 1);
+    }
+
+    for(const uint8_t* pc = (const uint8_t*)text; *pc && x0 < s->clip.x1; pc++)
     {
-        x0 = xoff + draw_glyph(*pc, x0, y0, color, font_p);
+        x0 = xoff + draw_glyph(s, *pc, x0, y0, color, font_p);
     }
 }
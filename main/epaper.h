@@ -22,21 +22,333 @@
 
 #include "EmbeddedFonts.h"
 #include "epd.h"
+#include "region.h"
+
+/* the pattern of undashed outlines */
+#define DASH_SOLID 0xffffffffu
+
+/*
+ * 8x8 fill patterns, the top byte is row 0 with x = 0 in its most significant
+ * bit. Set bits take the fill color, clear bits the other one.
+ */
+#define PATTERN_SOLID       0xffffffffffffffffull
+#define PATTERN_HATCH_H     0xff00000000000000ull
+#define PATTERN_HATCH_V     0x8080808080808080ull
+#define PATTERN_HATCH_CROSS 0xff80808080808080ull
+#define PATTERN_DIAG_UP     0x0102040810204080ull   /* / */
+#define PATTERN_DIAG_DOWN   0x8040201008040201ull   /* \ */
+#define PATTERN_DOTS        0x8000000008000000ull
+
+/* pending runs flood_fill() keeps on the stack, 8 bytes each, before it moves them to the heap */
+#define FLOOD_STACK 32
+/* the most it moves to the heap, 8 KB; the screen's scenes stay below 400 */
+#define FLOOD_MAX_SPANS 1024
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-    extern uint8_t framebuffer[EPD_BYTES];
+    struct dlist;
+
+    /* clockwise turns of the drawing relative to the rows of the bits */
+    typedef enum
+    {
+        ROTATE_0,
+        ROTATE_90,
+        ROTATE_180,
+        ROTATE_270
+    } rotation_t;
+
+    /*
+     * A 1bpp drawing target, rows are packed MSB first, a set bit is white.
+     * Drawing coordinates are logical: the first pixel of bits sits at
+     * (org_x, org_y), so a surface can hold just a window of a larger canvas,
+     * e.g. one band of the screen. Nothing outside clip is ever written.
+     */
+    typedef struct
+    {
+        uint8_t* bits;
+        int width;
+        int height;
+        int stride;             /* bytes per row */
+        int org_x;
+        int org_y;
+        rect_t clip;            /* logical, never larger than the bits */
+        region_t dirty;         /* pixels modified since the last surface_reset_dirty() */
+        struct dlist* list;     /* if set, primitives are recorded here instead, see dlist.h */
+        uint32_t dash;          /* outline pattern, see surface_set_dash() */
+        int dash_phase;         /* pattern bit the next outline pixel uses */
+        uint64_t pattern;       /* fill pattern, see surface_set_pattern() */
+        rotation_t orientation; /* see surface_set_orientation() */
+    } surface_t;
+
+    /* read-only 1bpp source image, same layout as a surface */
+    typedef struct
+    {
+        const uint8_t* bits;
+        int width;
+        int height;
+        int stride;
+    } bitmap_t;
+
+    /*
+     * An image with transparency: where a bit of mask is set the sprite
+     * shows the bit of bits, elsewhere what is underneath. Both planes have
+     * the layout of a bitmap_t.
+     */
+    typedef struct
+    {
+        const uint8_t* bits;
+        const uint8_t* mask;
+        int width;
+        int height;
+        int stride;
+    } sprite_t;
+
+    typedef struct
+    {
+        int16_t x;
+        int16_t y;
+    } point_t;
+
+    /* which pixels enclosed by a polygon's edges are inside */
+    typedef enum
+    {
+        FILL_EVEN_ODD,          /* crossed an odd number of edges */
+        FILL_NONZERO            /* edges wind around it a non-zero number of times */
+    } fill_rule_t;
+
+    typedef enum
+    {
+        CAP_BUTT,               /* ends square at the end points */
+        CAP_ROUND,              /* half discs around the end points */
+        CAP_SQUARE              /* ends square half the width beyond the end points */
+    } line_cap_t;
+
+    typedef enum
+    {
+        JOIN_MITER,             /* sharp corners, bevelled beyond miter_limit */
+        JOIN_BEVEL,             /* corners cut off straight */
+        JOIN_ROUND
+    } line_join_t;
+
+    /* how wide lines are drawn; miter_limit is the longest miter relative to the width, 0 for 4 */
+    typedef struct
+    {
+        int width;
+        line_cap_t cap;
+        line_join_t join;
+        int miter_limit;
+    } stroke_t;
+
+    /* raster operations applied by blit(), d is the destination, s the source */
+    typedef enum
+    {
+        ROP_COPY,               /* d = s */
+        ROP_OR,                 /* d = d | s */
+        ROP_AND,                /* d = d & s */
+        ROP_XOR,                /* d = d ^ s */
+        ROP_ANDNOT,             /* d = d & ~s */
+        ROP_INVERT              /* d = ~s */
+    } rop_t;
+
+    /*
+     * Surfaces are not locked. A buffer shown by one task while another draws
+     * needs an owner: see pipeline_t in render.h, which keeps its own frames
+     * and hands them between the renderer and the scanout task.
+     */
+    extern uint8_t framebuffer[EPD_FRAME_BYTES];
+    extern surface_t screen;
+
+    extern void surface_init(surface_t* s, uint8_t* bits, int width, int height);
+
+    /* makes s a window of height rows of a canvas, starting at canvas row y */
+    extern void surface_init_band(surface_t* s, uint8_t* bits, int width, int y, int height);
+
+    /* restricts drawing to the inclusive rectangle, within the extent of the bits */
+    extern void surface_set_clip(surface_t* s, int x0, int y0, int x1, int y1);
+
+    /* moves everything drawn on s afterwards by dx, dy, clip included */
+    extern void surface_translate(surface_t* s, int dx, int dy);
+
+    /*
+     * Turns the drawing on s by rot relative to its bits, e.g. ROTATE_90 to
+     * draw upright on a panel mounted in portrait, and resets the origin and
+     * the clip. For a quarter turn width and height swap, so that the logical
+     * extent matches the mounted panel. Filled rows of a quarter turn run down
+     * the columns of the bits and blits go through an 8x8 bit transpose.
+     * The dirty region of a rotated surface is in the coordinates of the bits.
+     * Band surfaces, and so render_banded() and render_parallel(), are not
+     * rotated.
+     */
+    extern void surface_set_orientation(surface_t* s, rotation_t rot);
+
+    /* maps logical (x, y) of s to the pixel of the bits it is stored in */
+    static inline void surface_to_bits(const surface_t* s, int* x, int* y)
+    {
+        int lx = *x - s->org_x, ly = *y - s->org_y;
+        switch(s->orientation)
+        {
+            case ROTATE_0:   *x = lx;                 *y = ly;                 break;
+            case ROTATE_90:  *x = s->height - 1 - ly; *y = lx;                 break;
+            case ROTATE_180: *x = s->width - 1 - lx;  *y = s->height - 1 - ly; break;
+            case ROTATE_270: *x = ly;                 *y = s->width - 1 - lx;  break;
+        }
+    }
+
+    /* the inverse of surface_to_bits() */
+    static inline void surface_from_bits(const surface_t* s, int* x, int* y)
+    {
+        int bx = *x, by = *y;
+        switch(s->orientation)
+        {
+            case ROTATE_0:   *x = bx;                 *y = by;                 break;
+            case ROTATE_90:  *x = by;                 *y = s->height - 1 - bx; break;
+            case ROTATE_180: *x = s->width - 1 - bx;  *y = s->height - 1 - by; break;
+            case ROTATE_270: *x = s->width - 1 - by;  *y = bx;                 break;
+        }
+        *x += s->org_x;
+        *y += s->org_y;
+    }
+
+    /*
+     * Dashes the outlines drawn afterwards by draw_line(), draw_rect() and
+     * draw_circle(). pattern holds bits on/off bits (8, 16 or 32), the most
+     * significant first, and is repeated along the outline; gaps leave the
+     * pixels alone. The phase starts at the first bit and carries on from one
+     * outline to the next, so a dashed polyline looks like one line.
+     * DASH_SOLID turns dashing off.
+     */
+    extern void surface_set_dash(surface_t* s, uint32_t pattern, int bits);
+
+    /*
+     * Sets the 8x8 pattern the filled primitives drawn afterwards use, one of
+     * the PATTERN_ constants or pattern_gray(). Patterns are anchored to the
+     * logical coordinates, so neighbouring fills line up, and they are opaque:
+     * a fill still covers everything underneath.
+     */
+    extern void surface_set_pattern(surface_t* s, uint64_t pattern);
+
+    /* ordered dither with level of 64 pixels in the fill color, 0 to 64 */
+    extern uint64_t pattern_gray(int level);
+
+    /*
+     * Every primitive extends the dirty region of its surface by the clipped
+     * bounding box of what it drew. Code that writes to the bits directly
+     * should report the area it touched with surface_mark_dirty().
+     */
+    extern void surface_mark_dirty(surface_t* s, int x0, int y0, int x1, int y1);
+    extern void surface_reset_dirty(surface_t* s);
+
+    static inline const region_t* surface_dirty(const surface_t* s)
+    {
+        return &s->dirty;
+    }
+
+    extern void clear(surface_t* s, int color);
+    extern void set_pixel(surface_t* s, int x, int y, int color);
+    extern void draw_line(surface_t* s, int x0, int y0, int x1, int y1, int color);
+    extern void draw_circle(surface_t* s, int xc, int yc, int r, int color);
+    extern void draw_filled_circle(surface_t* s, int xc, int yc, int r, int color);
+    extern void draw_filled_ellipse(surface_t* s, int xc, int yc, int a, int b, int color);
+    extern void draw_rect(surface_t* s, int x0, int y0, int x1, int y1, int color);
+    extern void draw_filled_rect(surface_t* s, int x0, int y0, int x1, int y1, int color);
+
+    /* rectangles with corners rounded to radius r, limited to half the shorter side */
+    extern void draw_round_rect(surface_t* s, int x0, int y0, int x1, int y1, int r, int color);
+    extern void draw_filled_round_rect(surface_t* s, int x0, int y0, int x1, int y1, int r, int color);
+
+    /*
+     * Angles are in degrees, 0 points right and they grow clockwise on the
+     * screen; the arc runs clockwise from start to end, start and end 360 or
+     * more apart give the whole circle. draw_arc() draws the pixels of
+     * draw_circle() that fall into the sweep, draw_filled_arc() fills the
+     * sector of the ring between radii r0 and r1 (both included) and
+     * draw_pie() the sector of the disc.
+     */
+    extern void draw_arc(surface_t* s, int xc, int yc, int r, int start, int end, int color);
+    extern void draw_filled_arc(surface_t* s, int xc, int yc, int r0, int r1, int start, int end, int color);
+    extern void draw_pie(surface_t* s, int xc, int yc, int r, int start, int end, int color);
+    extern void draw_text(surface_t* s, const char* text, int x0, int y0, int color, const lv_font_t * font_p, int xoff, int yoff);
+
+    /*
+     * Fills the polygon through the n points, closing it back to the first.
+     * A pixel is filled if its centre lies inside according to rule.
+     */
+    extern void draw_filled_polygon(surface_t* s, const point_t* pts, int n, fill_rule_t rule, int color);
+
+    /*
+     * Fills several closed contours as one shape, so that the rule decides
+     * about holes and overlaps. The points of all contours follow each
+     * other in pts, counts holds the number of points of each contour.
+     */
+    extern void draw_filled_polygons(surface_t* s, const point_t* pts, const int16_t* counts, int ncontours, fill_rule_t rule, int color);
+
+    /*
+     * Wide lines. The outline of the whole stroke, caps and joins included,
+     * is filled as one shape, so every covered pixel is written once. A width
+     * of 1 or less draws plain 1 pixel lines.
+     */
+    extern void draw_thick_line(surface_t* s, int x0, int y0, int x1, int y1, const stroke_t* style, int color);
+
+    /* connects the n points, and the last back to the first if closed */
+    extern void draw_polyline(surface_t* s, const point_t* pts, int n, int closed, const stroke_t* style, int color);
+
+    /*
+     * Fills the area of pixels of the same value as (x, y) that are connected
+     * to it horizontally or vertically, up to the clip rectangle, with color.
+     * Works in place on whole bytes with the solid color, the fill pattern is
+     * not used. Pending runs are kept on the stack, FLOOD_STACK of them, and
+     * on the heap when a busy area needs more, never more than
+     * FLOOD_MAX_SPANS. Returns 0, or -1 if a run had to be dropped, because
+     * the limit was reached or the allocation failed, and parts of the area
+     * may be left unfilled; filling again from a pixel that was missed
+     * picks up the rest. On a recording
+     * surface the fill happens at replay, from the pixels drawn by then;
+     * replayed in bands it only fills what is reachable within each band.
+     */
+    extern int flood_fill(surface_t* s, int x, int y, int color);
+
+    /*
+     * Copies the w by h pixel block at (sx, sy) of src to (dx, dy) of dst,
+     * combining source and destination bits with rop. Neither side has to be
+     * byte aligned, the block is clipped against both bitmaps. On a rotated
+     * surface the block is turned with it, so a rotated view of a buffer
+     * (see surface_set_orientation()) blits bitmaps rotated into it.
+     */
+    extern void blit(surface_t* dst, int dx, int dy, const bitmap_t* src, int sx, int sy, int w, int h, rop_t rop);
+
+    /*
+     * Combines the rectangle (x0, y0) - (x1, y1) of src into dst at (dx, dy)
+     * with rop, e.g. to merge layers drawn on separate surfaces. Clipped
+     * against src and the clip of dst; the two must not share their bits.
+     * Surfaces turned the same way are combined on their bits a 32 bit word
+     * at a time, whole surfaces of the same stride as a single run.
+     */
+    extern void composite(surface_t* dst, int dx, int dy, const surface_t* src, int x0, int y0, int x1, int y1, rop_t rop);
+
+    /* combines all of src into dst, origin onto origin */
+    static inline void composite_surface(surface_t* dst, const surface_t* src, rop_t rop)
+    {
+        composite(dst, dst->org_x, dst->org_y, src, src->org_x, src->org_y,
+                  src->org_x + src->width - 1, src->org_y + src->height - 1, rop);
+    }
+
+    /*
+     * Draws sprite with its top left corner at (x, y) in a single pass,
+     * dst = (dst & ~mask) | (bits & mask), clipped, at any x alignment.
+     */
+    extern void draw_sprite(surface_t* dst, int x, int y, const sprite_t* sprite);
 
-    extern void clear(int color);
-    extern void set_pixel(int x, int y, int color);
-    extern void draw_line(int x0, int y0, int x1, int y1, int color);
-    extern void draw_circle(int xc, int yc, int r, int color);
-    extern void draw_filled_circle(int xc, int yc, int r, int color);
-    extern void draw_rect(int x0, int y0, int x1, int y1, int color);
-    extern void draw_filled_rect(int x0, int y0, int x1, int y1, int color);
-    extern void draw_text(const char* text, int x0, int y0, int color, const lv_font_t * font_p, int xoff, int yoff);
+    /*
+     * Moves what is inside the rectangle (x0, y0) - (x1, y1), clipped, by dx,
+     * dy within it and fills the part uncovered with color; the rest of the
+     * surface is left alone. Rows move as whole byte runs, sideways moves of
+     * any number of pixels are funnel shifts 32 bits at a time. Like
+     * flood_fill(), a recorded scroll works on what was drawn before it and
+     * needs the whole rectangle in the surface it is replayed on.
+     */
+    extern void scroll_rect(surface_t* s, int x0, int y0, int x1, int y1, int dx, int dy, int color);
 
 #ifdef __cplusplus
 }
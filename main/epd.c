@@ -8,11 +8,27 @@
 #include "driver/spi_master.h"
 
 #include "epd.h"
+#include "bitops.h"
+
+// panel rows transformed per chunk, a chunk per bounce buffer
+#define SCAN_ROWS 8
 
 const int spi_dma_channel = 1;
 
 static spi_device_handle_t epd_spi;
 
+static epd_stats_t stats;
+
+// hash of the image on the panel, only meaningful while panel_hash_valid is set
+static uint32_t panel_hash;
+static int panel_hash_valid;
+
+static int scanout;
+
+// one chunk is transformed while the other one is on the bus
+DRAM_ATTR static uint8_t bounce[2][SCAN_ROWS * EPD_BYTES_PER_ROW];
+static spi_transaction_t bounce_trans[2];
+
 DRAM_ATTR static uint8_t lut_vcom0[] =
 {
     0x00, 0x17, 0x00, 0x00, 0x00, 0x02,        
@@ -174,6 +190,7 @@ static void send_command(uint8_t cmd)
 
 static void epd_refresh()
 {
+    ++stats.refreshes;
     send_command(DISPLAY_REFRESH);
     epd_wait();
 }
@@ -230,15 +247,313 @@ void epd_clear(void)
     }
 
     epd_refresh();
+    panel_hash_valid = 0;
 }
 
-void epd_display(void* framebuffer) 
+/*
+ * FNV-1a, a word at a time for aligned images. Any change confined to a
+ * single word is guaranteed to change the hash.
+ */
+static uint32_t frame_hash(const void* image, int length)
 {
-    send_command(DATA_START_TRANSMISSION_1);
-    send_data(framebuffer, EPD_BYTES);
+    uint32_t hash = 2166136261u;
+    if (((uintptr_t)image & 0x3) == 0)
+    {
+        const uint32_t* words = (const uint32_t*)image;
+        for(int i = 0; i < length / 4; ++i)
+        {
+            hash = (hash ^ words[i]) * 16777619u;
+        }
+        const uint8_t* tail = (const uint8_t*)(words + length / 4);
+        for(int i = 0; i < (length & 0x3); ++i)
+        {
+            hash = (hash ^ tail[i]) * 16777619u;
+        }
+    }
+    else
+    {
+        const uint8_t* bytes = (const uint8_t*)image;
+        for(int i = 0; i < length; ++i)
+        {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+    }
+    return hash;
+}
 
-    send_command(DATA_START_TRANSMISSION_2);
-    send_data(framebuffer, EPD_BYTES);
+static inline uint8_t rev8(uint8_t b)
+{
+    return bitrev32(b) >> 24;
+}
+
+/* 8 pixels of row y of a portrait image from column x on, zero outside */
+static uint8_t portrait8(const uint8_t* image, int x, int y)
+{
+    const uint8_t* row = image + y * EPD_PORTRAIT_BYTES_PER_ROW;
+    int i = x >> 3, r = x & 0x7;
+    uint8_t hi = (i >= 0 && i < EPD_PORTRAIT_BYTES_PER_ROW)? row[i] : 0;
+    uint8_t lo = (r && i + 1 < EPD_PORTRAIT_BYTES_PER_ROW)? row[i + 1] : 0;
+    return (r)? (hi << r) | (lo >> (8 - r)) : hi;
+}
+
+/*
+ * Panel rows y to y + n - 1 of the transformed image, full width, into out.
+ * Panel pixel (px, py) shows image pixel (X, Y) with, before mirroring,
+ * X = px, Y = py unrotated, X = py, Y = W - 1 - px for 90 degrees,
+ * X = W - 1 - px, Y = H - 1 - py for 180 and X = H - 1 - py, Y = px for 270.
+ */
+static void scan_rows(const uint8_t* image, int y, int n, uint8_t* out)
+{
+    int rot = scanout & 0x3;
+    int mirror = (scanout & EPD_SCAN_MIRROR) != 0;
+    uint8_t invert = (scanout & EPD_SCAN_INVERT)? 0xff : 0x00;
+
+    if ((rot & 1) == 0)
+    {
+        // whole rows, reversed for 180 degrees or a mirror; EPD_WIDTH is a whole number of bytes
+        int reverse = (rot == 2) != mirror;
+        for(int k = 0; k < n; ++k, out += EPD_BYTES_PER_ROW)
+        {
+            int py = y + k;
+            const uint8_t* src = image + ((rot == 2)? EPD_HEIGHT - 1 - py : py) * EPD_BYTES_PER_ROW;
+            for(int b = 0; b < EPD_BYTES_PER_ROW; ++b)
+            {
+                out[b] = (reverse? rev8(src[EPD_BYTES_PER_ROW - 1 - b]) : src[b]) ^ invert;
+            }
+        }
+        return;
+    }
+
+    // a quarter turn: 8x8 tiles, gathered from 8 image rows and transposed
+    int forward = (rot == 1) != mirror;
+    for(int px = 0; px < EPD_WIDTH; px += 8)
+    {
+        uint64_t m = 0;
+        for(int j = 0; j < 8; ++j)
+        {
+            int Y = (rot == 1)? EPD_WIDTH - 1 - (px + j) : px + j;
+            uint8_t v = forward? portrait8(image, y, Y) : rev8(portrait8(image, EPD_HEIGHT - 8 - y, Y));
+            m = (m << 8) | v;
+        }
+        m = transpose8(m);
+        for(int k = 0; k < n; ++k)
+        {
+            out[k * EPD_BYTES_PER_ROW + (px >> 3)] = (uint8_t)(m >> (56 - 8 * k)) ^ invert;
+        }
+    }
+}
+
+/* panel position of image pixel (x, y), the inverse of scan_rows() */
+static void scan_point(int* x, int* y)
+{
+    int X = *x, Y = *y;
+    if (scanout & EPD_SCAN_MIRROR)
+    {
+        X = ((scanout & 1)? EPD_HEIGHT : EPD_WIDTH) - 1 - X;
+    }
+    switch(scanout & 0x3)
+    {
+        case 0: *x = X;                  *y = Y;                   break;
+        case 1: *x = EPD_WIDTH - 1 - Y;  *y = X;                   break;
+        case 2: *x = EPD_WIDTH - 1 - X;  *y = EPD_HEIGHT - 1 - Y;  break;
+        case 3: *x = Y;                  *y = EPD_HEIGHT - 1 - X;  break;
+    }
+}
+
+/*
+ * Streams bytes b0 to b1 - 1 of panel rows y0 to y1 - 1 of the transformed
+ * image, alternating between the bounce buffers with queued transactions.
+ */
+static void send_scan(const uint8_t* image, int y0, int y1, int b0, int b1)
+{
+    int bytes = b1 - b0;
+    int pending[2] = { 0, 0 };
+    int cur = 0;
+    spi_transaction_t* done;
+    for(int y = y0; y < y1; y += SCAN_ROWS, cur ^= 1)
+    {
+        int n = (y1 - y < SCAN_ROWS)? y1 - y : SCAN_ROWS;
+        if (pending[cur])
+        {
+            // in order, the oldest transaction is the one on this buffer
+            esp_err_t ret = spi_device_get_trans_result(epd_spi, &done, portMAX_DELAY);
+            assert(ret == ESP_OK);
+            pending[cur] = 0;
+        }
+        uint8_t* buf = bounce[cur];
+        scan_rows(image, y, n, buf);
+        if (bytes != EPD_BYTES_PER_ROW)
+        {
+            for(int k = 0; k < n; ++k)
+            {
+                memmove(buf + k * bytes, buf + k * EPD_BYTES_PER_ROW + b0, bytes);
+            }
+        }
+
+        spi_transaction_t* t = &bounce_trans[cur];
+        memset(t, 0, sizeof(*t));
+        t->length = (n * bytes) << 3;
+        t->tx_buffer = buf;
+        t->user = (void*)1;
+        esp_err_t ret = spi_device_queue_trans(epd_spi, t, portMAX_DELAY);
+        assert(ret == ESP_OK);
+        pending[cur] = 1;
+    }
+    for(int i = 0; i < 2; ++i)
+    {
+        if (pending[i])
+        {
+            esp_err_t ret = spi_device_get_trans_result(epd_spi, &done, portMAX_DELAY);
+            assert(ret == ESP_OK);
+        }
+    }
+}
+
+void epd_set_scanout(int transform)
+{
+    scanout = transform;
+    panel_hash_valid = 0;
+}
+
+int epd_get_scanout(void)
+{
+    return scanout;
+}
+
+int epd_frame_unchanged(const void* image)
+{
+    return panel_hash_valid && frame_hash(image, (scanout & 1)? EPD_PORTRAIT_BYTES : EPD_BYTES) == panel_hash;
+}
+
+int epd_display(void* framebuffer) 
+{
+    ++stats.frames;
+    uint32_t hash = frame_hash(framebuffer, (scanout & 1)? EPD_PORTRAIT_BYTES : EPD_BYTES);
+    if (panel_hash_valid && hash == panel_hash)
+    {
+        ++stats.skipped;
+        return 0;
+    }
+
+    for(int plane = 0; plane < 2; ++plane)
+    {
+        send_command(plane? DATA_START_TRANSMISSION_2 : DATA_START_TRANSMISSION_1);
+        if (scanout == EPD_SCAN_NORMAL)
+        {
+            send_data(framebuffer, EPD_BYTES);
+        }
+        else
+        {
+            send_scan(framebuffer, 0, EPD_HEIGHT, 0, EPD_BYTES_PER_ROW);
+        }
+    }
 
     epd_refresh();
+    panel_hash = hash;
+    panel_hash_valid = 1;
+    return 1;
+}
+
+static void send_window(const uint8_t* rows, int bytes, int count)
+{
+    if (bytes == EPD_BYTES_PER_ROW)
+    {
+        // full width rows are contiguous
+        send_data(rows, bytes * count);
+        return;
+    }
+    for(int row = 0; row < count; ++row)
+    {
+        send_data(rows + row * EPD_BYTES_PER_ROW, bytes);
+    }
+}
+
+void epd_display_window(const void* framebuffer, int x, int y, int w, int h)
+{
+    if (scanout & 1)
+    {
+        // rows of a portrait image are columns of the panel, refresh it all
+        epd_display((void*)framebuffer);
+        return;
+    }
+    if (scanout != EPD_SCAN_NORMAL)
+    {
+        if (w <= 0 || h <= 0)
+        {
+            return;
+        }
+        // the window's corners on the panel
+        int ax = x, ay = y, bx = x + w - 1, by = y + h - 1;
+        scan_point(&ax, &ay);
+        scan_point(&bx, &by);
+        x = (ax < bx)? ax : bx;
+        y = (ay < by)? ay : by;
+        w = ((ax < bx)? bx - ax : ax - bx) + 1;
+        h = ((ay < by)? by - ay : ay - by) + 1;
+    }
+    int x0 = x & ~0x7;
+    int x1 = (x + w + 7) & ~0x7;
+    int y1 = y + h;
+    if (x0 < 0) x0 = 0;
+    if (y < 0) y = 0;
+    if (x1 > EPD_WIDTH) x1 = EPD_WIDTH;
+    if (y1 > EPD_HEIGHT) y1 = EPD_HEIGHT;
+    if (x0 >= x1 || y >= y1)
+    {
+        return;
+    }
+
+    uint8_t window[] = {
+        x0 >> 8, x0 & 0xf8,
+        (x1 - 1) >> 8, (x1 - 1) | 0x07,
+        y >> 8, y & 0xff,
+        (y1 - 1) >> 8, (y1 - 1) & 0xff,
+        0x01                                    // gates scan inside and outside of the window
+    };
+
+    const uint8_t* rows = (const uint8_t*)framebuffer + y * EPD_BYTES_PER_ROW + (x0 >> 3);
+    int bytes = (x1 - x0) >> 3;
+
+    send_command(PARTIAL_IN);
+    send_command(PARTIAL_WINDOW);
+    send_data(window, sizeof(window));
+
+    for(int plane = 0; plane < 2; ++plane)
+    {
+        send_command(plane? DATA_START_TRANSMISSION_2 : DATA_START_TRANSMISSION_1);
+        if (scanout == EPD_SCAN_NORMAL)
+        {
+            send_window(rows, bytes, y1 - y);
+        }
+        else
+        {
+            send_scan((const uint8_t*)framebuffer, y, y1, x0 >> 3, x1 >> 3);
+        }
+    }
+
+    epd_refresh();
+    send_command(PARTIAL_OUT);
+    panel_hash_valid = 0;
+}
+
+void epd_stream_begin(int plane)
+{
+    send_command(plane == 1? DATA_START_TRANSMISSION_1 : DATA_START_TRANSMISSION_2);
+}
+
+void epd_stream_write(const void* data, int length)
+{
+    send_data(data, length);
+}
+
+void epd_stream_end(void)
+{
+    ++stats.frames;
+    epd_refresh();
+    panel_hash_valid = 0;
+}
+
+void epd_get_stats(epd_stats_t* out)
+{
+    *out = stats;
 }
@@ -1,11 +1,20 @@
 #ifndef __EPD_H__
 #define __EPD_H__
 
+#include <stdint.h>
+
 #define EPD_WIDTH  400
 #define EPD_HEIGHT 300
 #define EPD_BYTES_PER_ROW ((EPD_WIDTH+7)/8)
 #define EPD_BYTES EPD_HEIGHT*EPD_BYTES_PER_ROW
 
+// images drawn in portrait for a quarter turn scanout, see epd_set_scanout()
+#define EPD_PORTRAIT_BYTES_PER_ROW ((EPD_HEIGHT+7)/8)
+#define EPD_PORTRAIT_BYTES (EPD_WIDTH*EPD_PORTRAIT_BYTES_PER_ROW)
+
+// frame buffers hold either layout
+#define EPD_FRAME_BYTES ((EPD_BYTES > EPD_PORTRAIT_BYTES)? EPD_BYTES : EPD_PORTRAIT_BYTES)
+
 // EPD4IN2 commands
 #define PANEL_SETTING                               0x00
 #define POWER_SETTING                               0x01
@@ -57,14 +66,83 @@
 extern "C" {
 #endif
 
+typedef struct
+{
+    uint32_t frames;        /* full frames submitted */
+    uint32_t refreshes;     /* full and partial panel refreshes */
+    uint32_t skipped;       /* frames identical to the one on the panel */
+} epd_stats_t;
+
+/*
+ * Scanout transforms: a clockwise rotation of the image onto the panel,
+ * optionally combined with EPD_SCAN_MIRROR, which mirrors the image left to
+ * right before it is rotated, and EPD_SCAN_INVERT.
+ */
+enum
+{
+    EPD_SCAN_NORMAL = 0,
+    EPD_SCAN_ROTATE_90 = 1,
+    EPD_SCAN_ROTATE_180 = 2,
+    EPD_SCAN_ROTATE_270 = 3,
+    EPD_SCAN_MIRROR = 4,
+    EPD_SCAN_INVERT = 8
+};
+
 extern void epd_init(void);
 extern void epd_uninit(void);
 
 extern void epd_wakeup(void);
 extern void epd_clear(void);
-extern void epd_display(void* image);
+/*
+ * Transfers and refreshes the whole image. A hash of the last image sent is
+ * kept, an identical image is neither transferred nor refreshed. Returns 0
+ * if the refresh was skipped.
+ */
+extern int epd_display(void* image);
+
+/*
+ * Whether epd_display() would skip image as the one already shown. Lets a
+ * caller leave a sleeping panel asleep, the check touches no hardware and
+ * is not counted in the stats.
+ */
+extern int epd_frame_unchanged(const void* image);
+
+/*
+ * Transfers and refreshes only the window x, y, w, h of the image using the
+ * panel's partial window. x and w are widened to whole bytes of the panel.
+ * Under a quarter turn scanout the image's rows cross the panel's, the
+ * whole image is sent through epd_display() instead.
+ */
+extern void epd_display_window(const void* image, int x, int y, int w, int h);
 extern void epd_sleep(void);
 
+/*
+ * Piecewise transfer for images that never exist in RAM as a whole. Like
+ * epd_display, every image is sent twice: epd_stream_begin(1) followed by
+ * the rows of the image in order through epd_stream_write(), the same again
+ * for plane 2, then epd_stream_end() refreshes the panel.
+ */
+extern void epd_stream_begin(int plane);
+extern void epd_stream_write(const void* data, int length);
+extern void epd_stream_end(void);
+
+/*
+ * Sets the transform epd_display() and epd_display_window() apply while they
+ * stream an image out, so it can be drawn in its natural orientation
+ * without a second frame buffer or a rotation pass. Images for a quarter
+ * turn are EPD_HEIGHT pixels wide and EPD_WIDTH high, with
+ * EPD_PORTRAIT_BYTES_PER_ROW bytes per row, a little more than EPD_BYTES
+ * in all; frame buffers are EPD_FRAME_BYTES long to hold either. Windows
+ * are in image coordinates and, for a quarter turn, refresh the whole
+ * panel. Transformed rows go out through a bounce buffer of a few rows, the
+ * next chunk is transformed while the last one is being sent. Streamed
+ * images are sent as they are.
+ */
+extern void epd_set_scanout(int transform);
+extern int epd_get_scanout(void);
+
+extern void epd_get_stats(epd_stats_t* stats);
+
 #ifdef __cplusplus
 }
 #endif
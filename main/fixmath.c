@@ -0,0 +1,50 @@
+
+#include "fixmath.h"
+
+// sin(0..90 degrees) * FIX_ONE
+static const int16_t sine[91] =
+{
+        0,   286,   572,   857,  1143,  1428,  1713,  1997,  2280,  2563,
+     2845,  3126,  3406,  3686,  3964,  4240,  4516,  4790,  5063,  5334,
+     5604,  5872,  6138,  6402,  6664,  6924,  7182,  7438,  7692,  7943,
+     8192,  8438,  8682,  8923,  9162,  9397,  9630,  9860, 10087, 10311,
+    10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+    12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+    14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+    15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+    16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+    16384
+};
+
+int32_t isin(int deg)
+{
+    deg %= 360;
+    if (deg < 0) deg += 360;
+    if (deg <= 90) return sine[deg];
+    if (deg <= 180) return sine[180 - deg];
+    if (deg <= 270) return -sine[deg - 180];
+    return -sine[360 - deg];
+}
+
+int32_t icos(int deg)
+{
+    return isin(deg + 90);
+}
+
+uint32_t isqrt(uint64_t v)
+{
+    uint64_t r = 0;
+    for(uint64_t bit = 1ull << 62; bit; bit >>= 2)
+    {
+        if (v >= r + bit)
+        {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        }
+        else
+        {
+            r >>= 1;
+        }
+    }
+    return (uint32_t)r;
+}
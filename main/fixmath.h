@@ -0,0 +1,30 @@
+/*
+ * Integer replacements for the bits of math.h the drawing code needs: sines
+ * of whole degrees in Q14 fixed point and integer square roots.
+ */
+
+/* inclusion guard */
+#ifndef __FIXMATH_H__
+#define __FIXMATH_H__
+
+#include <stdint.h>
+
+/* 1.0 in the Q14 results of isin() and icos() */
+#define FIX_ONE 16384
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /* sine and cosine of an angle in degrees, any value, times FIX_ONE */
+    extern int32_t isin(int deg);
+    extern int32_t icos(int deg);
+
+    /* floor(sqrt(v)) */
+    extern uint32_t isqrt(uint64_t v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FIXMATH_H__ */
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+#include "epaper.h"
+#include "dlist.h"
+
+/*
+ * A run filled on row y whose neighbours on row y + dy are still to be
+ * looked at. Columns are relative to the bits of the surface.
+ */
+typedef struct
+{
+    int16_t x0;
+    int16_t x1;
+    int16_t y;
+    int16_t dy;
+} flood_span_t;
+
+typedef struct
+{
+    int x0, y0, x1, y1;         /* the clip in bit columns and rows, exclusive */
+    int v;                      /* the value of the pixels being replaced */
+    flood_span_t* stack;        /* local, or on the heap once that ran full */
+    int size;
+    int depth;
+    int overflow;
+    flood_span_t local[FLOOD_STACK];
+} flood_t;
+
+static inline int get(const uint8_t* row, int x)
+{
+    return (row[x >> 3] >> (7 - (x & 7))) & 1;
+}
+
+/* the first pixel in x to end - 1 whose value is v, end if there is none */
+static int find_right(const uint8_t* row, int x, int end, int v)
+{
+    while(x < end)
+    {
+        uint8_t m = (v? row[x >> 3] : ~row[x >> 3]) & (0xff >> (x & 7));
+        if (m)
+        {
+            x = (x & ~7) + __builtin_clz(m) - 24;
+            return (x < end)? x : end;
+        }
+        x = (x & ~7) + 8;
+    }
+    return end;
+}
+
+/* the last pixel in start to x whose value is v, start - 1 if there is none */
+static int find_left(const uint8_t* row, int x, int start, int v)
+{
+    while(x >= start)
+    {
+        uint8_t m = (v? row[x >> 3] : ~row[x >> 3]) & (0xff << (7 - (x & 7)));
+        if (m)
+        {
+            x = (x | 7) - __builtin_ctz(m);
+            return (x >= start)? x : start - 1;
+        }
+        x = (x & ~7) - 1;
+    }
+    return start - 1;
+}
+
+static void fill(uint8_t* row, int x0, int x1, int color)
+{
+    uint8_t fill = (color)? 0xff : 0x00;
+    uint8_t* p = row + (x0 >> 3);
+    uint8_t* end = row + (x1 >> 3);
+    uint8_t first = 0xff >> (x0 & 7), last = 0xff << (7 - (x1 & 7));
+    if (p == end)
+    {
+        first &= last;
+    }
+    *p = (*p & ~first) | (fill & first);
+    if (p == end)
+    {
+        return;
+    }
+    while(++p < end)
+    {
+        *p = fill;
+    }
+    *p = (*p & ~last) | (fill & last);
+}
+
+static void push(flood_t* f, int x0, int x1, int y, int dy)
+{
+    if (y + dy < f->y0 || y + dy >= f->y1)
+    {
+        return;
+    }
+    if (f->depth == f->size)
+    {
+        // busy areas need more runs than fit on the task's stack, up to a limit
+        if (f->size >= FLOOD_MAX_SPANS)
+        {
+            f->overflow = 1;
+            return;
+        }
+        int size = (2 * f->size < FLOOD_MAX_SPANS)? 2 * f->size : FLOOD_MAX_SPANS;
+        flood_span_t* stack = (flood_span_t*)malloc(size * sizeof(flood_span_t));
+        if (stack == NULL)
+        {
+            f->overflow = 1;
+            return;
+        }
+        memcpy(stack, f->stack, f->depth * sizeof(flood_span_t));
+        if (f->stack != f->local)
+        {
+            free(f->stack);
+        }
+        f->stack = stack;
+        f->size = size;
+    }
+    flood_span_t span = { x0, x1, y, dy };
+    f->stack[f->depth++] = span;
+}
+
+int flood_fill(surface_t* s, int x, int y, int color)
+{
+    if (s->list)
+    {
+        const int16_t args[] = { x, y, color };
+        dlist_record(s->list, DL_FLOOD_FILL, INT16_MIN, INT16_MIN, INT16_MAX, INT16_MAX, args, 3, 0);
+        return 0;
+    }
+    const rect_t* c = &s->clip;
+    if (x < c->x0 || x >= c->x1 || y < c->y0 || y >= c->y1)
+    {
+        return 0;
+    }
+
+    // connectivity does not care about orientation, the fill runs on the bits
+    flood_t f;
+    int ax = c->x0, ay = c->y0, bx = c->x1 - 1, by = c->y1 - 1;
+    surface_to_bits(s, &ax, &ay);
+    surface_to_bits(s, &bx, &by);
+    f.x0 = (ax < bx)? ax : bx;
+    f.x1 = ((ax < bx)? bx : ax) + 1;
+    f.y0 = (ay < by)? ay : by;
+    f.y1 = ((ay < by)? by : ay) + 1;
+    f.stack = f.local;
+    f.size = FLOOD_STACK;
+    f.depth = 0;
+    f.overflow = 0;
+    surface_to_bits(s, &x, &y);
+
+    uint8_t* row = s->bits + y * s->stride;
+    f.v = get(row, x);
+    color = (color != 0);
+    if (f.v == color)
+    {
+        return 0;
+    }
+
+    int l = find_left(row, x, f.x0, color) + 1;
+    int r = find_right(row, x, f.x1, color) - 1;
+    fill(row, l, r, color);
+    int bx0 = l, bx1 = r, by0 = y, by1 = y;
+    push(&f, l, r, y, 1);
+    push(&f, l, r, y, -1);
+
+    while(f.depth)
+    {
+        flood_span_t p = f.stack[--f.depth];
+        int ny = p.y + p.dy;
+        row = s->bits + ny * s->stride;
+        // every run of the row below or above that touches the parent run
+        for(int i = find_right(row, p.x0, p.x1 + 1, f.v); i <= p.x1; i = find_right(row, i, p.x1 + 1, f.v))
+        {
+            int a = (i == p.x0)? find_left(row, i, f.x0, color) + 1 : i;
+            int b = find_right(row, i, f.x1, color) - 1;
+            fill(row, a, b, color);
+            push(&f, a, b, ny, p.dy);
+            // where the run sticks out past its parent it may lead back the other way
+            if (a < p.x0 - 1) push(&f, a, p.x0 - 2, ny, -p.dy);
+            if (b > p.x1 + 1) push(&f, p.x1 + 2, b, ny, -p.dy);
+            if (a < bx0) bx0 = a;
+            if (b > bx1) bx1 = b;
+            if (ny < by0) by0 = ny;
+            if (ny > by1) by1 = ny;
+            i = b + 2;
+        }
+    }
+
+    if (f.stack != f.local)
+    {
+        free(f.stack);
+    }
+
+    surface_from_bits(s, &bx0, &by0);
+    surface_from_bits(s, &bx1, &by1);
+    surface_mark_dirty(s, bx0, by0, bx1, by1);
+    return f.overflow? -1 : 0;
+}
@@ -0,0 +1,199 @@
+
+#include <string.h>
+#include "framediff.h"
+
+#define TILE_COLUMNS ((EPD_BYTES_PER_ROW + FRAMEDIFF_TILE_BYTES - 1) / FRAMEDIFF_TILE_BYTES)
+#define TILE_ROWS ((EPD_HEIGHT + FRAMEDIFF_TILE_ROWS - 1) / FRAMEDIFF_TILE_ROWS)
+
+// the frame last sent to the panel
+static uint32_t last_frame[(EPD_BYTES + 3) / 4];
+
+// cleared while the panel shows something last_frame does not know about,
+// which includes whatever it showed before the first frame
+static int last_frame_valid = 0;
+
+/*
+ * Scans the bytes [start, end) of the frame a word at a time and reports the
+ * leftmost and rightmost byte column that differs; if cols is given every
+ * differing column is flagged there as well. Only words that differ are
+ * looked at byte by byte. Returns 0 if the range is unchanged.
+ */
+static int scan_columns(const uint8_t* frame, int start, int end, uint8_t* cols, int* cmin, int* cmax)
+{
+    const uint8_t* last = (const uint8_t*)last_frame;
+    int found = 0;
+    int i = start;
+    int col = start % EPD_BYTES_PER_ROW;
+
+#define CHECK_BYTE(i, c) \
+    if (frame[i] != last[i]) \
+    { \
+        if ((c) < *cmin) *cmin = (c); \
+        if ((c) > *cmax) *cmax = (c); \
+        if (cols) cols[c] = 1; \
+        found = 1; \
+    }
+
+    // leading bytes up to the first word boundary
+    for(; i < end && (i & 0x3); ++i)
+    {
+        CHECK_BYTE(i, col);
+        if (++col == EPD_BYTES_PER_ROW) col = 0;
+    }
+
+    const uint32_t* a = (const uint32_t*)(frame + i);
+    const uint32_t* b = last_frame + (i >> 2);
+    for(; i + 4 <= end; i += 4, ++a, ++b)
+    {
+        if (*a != *b)
+        {
+            for(int k = 0; k < 4; ++k)
+            {
+                int c = col + k;
+                if (c >= EPD_BYTES_PER_ROW) c -= EPD_BYTES_PER_ROW;
+                CHECK_BYTE(i + k, c);
+            }
+            if (!cols && *cmin == 0 && *cmax == EPD_BYTES_PER_ROW - 1)
+            {
+                // cannot get any wider
+                return 1;
+            }
+        }
+        col += 4;
+        if (col >= EPD_BYTES_PER_ROW) col -= EPD_BYTES_PER_ROW;
+    }
+
+    for(; i < end; ++i)
+    {
+        CHECK_BYTE(i, col);
+        if (++col == EPD_BYTES_PER_ROW) col = 0;
+    }
+
+#undef CHECK_BYTE
+    return found;
+}
+
+int framediff_bounds(const uint8_t* frame, rect_t* changed)
+{
+    if (!last_frame_valid)
+    {
+        changed->x0 = 0;
+        changed->y0 = 0;
+        changed->x1 = EPD_WIDTH;
+        changed->y1 = EPD_HEIGHT;
+        return 1;
+    }
+
+    const uint8_t* last = (const uint8_t*)last_frame;
+    const uint32_t* a = (const uint32_t*)frame;
+    int words = EPD_BYTES / 4;
+
+    // first and last differing byte give the row range
+    int first = 0;
+    while(first < words && a[first] == last_frame[first]) ++first;
+    first *= 4;
+    while(first < EPD_BYTES && frame[first] == last[first]) ++first;
+    if (first == EPD_BYTES)
+    {
+        return 0;
+    }
+
+    int end = EPD_BYTES;
+    while(end > words * 4 && frame[end - 1] == last[end - 1]) --end;
+    if (end == words * 4)
+    {
+        int w = words;
+        while(a[w - 1] == last_frame[w - 1]) --w;
+        end = w * 4;
+        while(frame[end - 1] == last[end - 1]) --end;
+    }
+
+    int cmin = EPD_BYTES_PER_ROW, cmax = -1;
+    scan_columns(frame, first, end, NULL, &cmin, &cmax);
+
+    changed->x0 = cmin * 8;
+    changed->x1 = (cmax + 1) * 8;
+    changed->y0 = first / EPD_BYTES_PER_ROW;
+    changed->y1 = (end - 1) / EPD_BYTES_PER_ROW + 1;
+    return 1;
+}
+
+int framediff_tiles(const uint8_t* frame, rect_t* tiles, int max)
+{
+    if (!last_frame_valid)
+    {
+        return (max < 1)? -1 : framediff_bounds(frame, tiles);
+    }
+
+    int count = 0;
+    for(int ty = 0; ty < TILE_ROWS; ++ty)
+    {
+        int y0 = ty * FRAMEDIFF_TILE_ROWS;
+        int y1 = y0 + FRAMEDIFF_TILE_ROWS;
+        if (y1 > EPD_HEIGHT) y1 = EPD_HEIGHT;
+
+        // one pass over the band flags the differing byte columns
+        uint8_t cols[EPD_BYTES_PER_ROW];
+        memset(cols, 0, sizeof(cols));
+        int cmin = EPD_BYTES_PER_ROW, cmax = -1;
+        if (!scan_columns(frame, y0 * EPD_BYTES_PER_ROW, y1 * EPD_BYTES_PER_ROW, cols, &cmin, &cmax))
+        {
+            continue;
+        }
+
+        uint8_t dirty[TILE_COLUMNS];
+        memset(dirty, 0, sizeof(dirty));
+        for(int c = cmin; c <= cmax; ++c)
+        {
+            dirty[c / FRAMEDIFF_TILE_BYTES] |= cols[c];
+        }
+
+        for(int tx = 0; tx < TILE_COLUMNS; )
+        {
+            if (!dirty[tx])
+            {
+                ++tx;
+                continue;
+            }
+            int run = tx;
+            while(tx < TILE_COLUMNS && dirty[tx]) ++tx;
+            if (count == max)
+            {
+                return -1;
+            }
+            int x1 = tx * FRAMEDIFF_TILE_BYTES * 8;
+            tiles[count].x0 = run * FRAMEDIFF_TILE_BYTES * 8;
+            tiles[count].x1 = x1 > EPD_WIDTH? EPD_WIDTH : x1;
+            tiles[count].y0 = y0;
+            tiles[count].y1 = y1;
+            ++count;
+        }
+    }
+    return count;
+}
+
+void framediff_commit(const uint8_t* frame)
+{
+    memcpy(last_frame, frame, EPD_BYTES);
+    last_frame_valid = 1;
+}
+
+int framediff_display(const uint8_t* frame)
+{
+    if (epd_get_scanout() & 1)
+    {
+        // a portrait frame, whole refreshes only
+        last_frame_valid = 0;
+        return epd_display((void*)frame);
+    }
+
+    rect_t changed;
+    if (!framediff_bounds(frame, &changed))
+    {
+        return 0;
+    }
+
+    epd_display_window(frame, changed.x0, changed.y0, changed.x1 - changed.x0, changed.y1 - changed.y0);
+    framediff_commit(frame);
+    return 1;
+}
@@ -0,0 +1,58 @@
+/*
+ * Frame differencing against a retained copy of the last frame sent to the
+ * panel. Lets code that redraws the whole screen find out which part of it
+ * actually changed, so only that part needs to be transferred and refreshed.
+ */
+
+/* inclusion guard */
+#ifndef __FRAMEDIFF_H__
+#define __FRAMEDIFF_H__
+
+#include <stdint.h>
+
+#include "epd.h"
+#include "region.h"
+
+/* tile size used by framediff_tiles() */
+#define FRAMEDIFF_TILE_BYTES 8
+#define FRAMEDIFF_TILE_ROWS 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /*
+     * Bounding box of all pixels of frame that differ from the retained frame.
+     * Horizontally the box is widened to whole bytes, which is the granularity
+     * of the panel's partial window. Returns 0 if nothing changed. The frame
+     * has to be EPD_BYTES long and 32 bit aligned. Until a frame has been
+     * committed the whole screen counts as changed.
+     */
+    extern int framediff_bounds(const uint8_t* frame, rect_t* changed);
+
+    /*
+     * Changed tiles of FRAMEDIFF_TILE_BYTES by FRAMEDIFF_TILE_ROWS, adjacent
+     * tiles of a tile row joined into one rectangle. Returns the number of
+     * rectangles, or -1 if there are more than max of them.
+     */
+    extern int framediff_tiles(const uint8_t* frame, rect_t* tiles, int max);
+
+    /* records frame as the content now shown on the panel */
+    extern void framediff_commit(const uint8_t* frame);
+
+    /*
+     * Sends only the changed part of frame to the (awake) panel through a
+     * partial window refresh and commits it. Returns 0 without touching the
+     * panel if nothing changed. Frames are compared as landscape images;
+     * under a quarter turn scanout (see epd_set_scanout()) frame is a
+     * portrait image and is sent whole by epd_display() instead, and the
+     * next landscape frame is sent whole as well. The first frame is sent
+     * whole too, the panel's content is not known before.
+     */
+    extern int framediff_display(const uint8_t* frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FRAMEDIFF_H__ */
@@ -19,21 +19,40 @@
 
 #include "epaper.h"
 #include "epd.h"
+#include "dlist.h"
+#include "render.h"
+#include "cmdq.h"
 
 static const char* TAG="ESP32-test";
 
+static uint32_t scene_buf[1024];
+static dlist_t scene;
+
+// shows the frames from its own two buffers, framebuffer is only used without it
+static pipeline_t pipeline;
+static int pipelined;
+
+// draw commands posted by other tasks, drained into every frame
+static cmdq_slot_t overlay_slots[32];
+static cmdq_t overlay;
+
 void hello_task(void *pvParameter)
 {
     while(1) {
         ESP_LOGI(TAG, "Hello World");
+        const int16_t args[] = { rand() % EPD_WIDTH, rand() % EPD_HEIGHT, 0, 1, 0 };
+        cmdq_post(&overlay, DL_TEXT, args, 5, "Hello World", &lv_font_dejavu_20);
         vTaskDelay(10000 / portTICK_PERIOD_MS);
     }
 }
 
 void display_task(void *pvParameter)
 {
+    surface_t rec, frame;
     while(1) {
-        clear(1);
+        dlist_init(&scene, scene_buf, sizeof(scene_buf));
+        dlist_surface(&scene, &rec, EPD_WIDTH, EPD_HEIGHT);
+        clear(&rec, 1);
         for(int i = 0; i < 10; ++i) {
             int x0 = rand() % EPD_WIDTH;
             int y0 = rand() % EPD_HEIGHT;
@@ -43,37 +62,55 @@ void display_task(void *pvParameter)
             switch(i%10)
             {
                 case 0:
-                    draw_filled_rect(x0, y0, x1, y1, 0);
+                    draw_filled_rect(&rec, x0, y0, x1, y1, 0);
                     break;
                 case 1:
                 case 8:
-                    draw_rect(x0, y0, x1, y1, 0);
+                    draw_rect(&rec, x0, y0, x1, y1, 0);
                     break;
                 case 2:
                 case 9:
-                    draw_line(x0, y0, x1, y1, 0);
+                    draw_line(&rec, x0, y0, x1, y1, 0);
                     break;
                 case 3:
-                    draw_circle(x0, y0, r, 0);
+                    draw_circle(&rec, x0, y0, r, 0);
                     break;
                 case 4:
-                    draw_filled_circle(x0, y0, r, 0);
+                    draw_filled_circle(&rec, x0, y0, r, 0);
                     break;
                 case 5:
-                    draw_text("Lorem ipsum", x0, y0, 0, &lv_font_dejavu_10, 1, 0);
+                    draw_text(&rec, "Lorem ipsum", x0, y0, 0, &lv_font_dejavu_10, 1, 0);
                     break;
                 case 6:
-                    draw_text("Mimsy were the Borogroves", x0, y0, 0, &lv_font_dejavu_20, 1, 0);
+                    draw_text(&rec, "Mimsy were the Borogroves", x0, y0, 0, &lv_font_dejavu_20, 1, 0);
                     break;
                 case 7:
-                    draw_text("The quick brown fox", x0, y0, 0, &lv_font_dejavu_40, 1, 0);
+                    draw_text(&rec, "The quick brown fox", x0, y0, 0, &lv_font_dejavu_40, 1, 0);
                     break;
             }
         }
 
-        epd_wakeup();
-        epd_display((void*)(framebuffer));
-        epd_sleep();
+        cmdq_drain(&overlay, &rec);
+
+        // record, drop what is painted over, then rasterize on both cores
+        dlist_optimize(&scene);
+        if (!pipelined)
+        {
+            // no scanout task, show each frame from here
+            surface_init(&frame, framebuffer, EPD_WIDTH, EPD_HEIGHT);
+            render_parallel(&frame, dlist_render, &scene, 20);
+            epd_wakeup();
+            epd_display(framebuffer);
+            epd_sleep();
+            vTaskDelay(5000 / portTICK_PERIOD_MS);
+            continue;
+        }
+        pipeline_begin(&pipeline, &frame);
+        render_parallel(&frame, dlist_render, &scene, 20);
+        pipeline_present(&pipeline, &frame);
+        ESP_LOGI(TAG, "frame %u: waited for a buffer %u times, %u us max",
+                 (unsigned)pipeline.stats.acquired, (unsigned)pipeline.stats.contended,
+                 (unsigned)pipeline.stats.max_wait_us);
         vTaskDelay(5000 / portTICK_PERIOD_MS);
     }
 }
@@ -81,6 +118,12 @@ void display_task(void *pvParameter)
 void app_main()
 {
     epd_init();
+    cmdq_init(&overlay, overlay_slots, 32);
+    pipelined = (pipeline_init(&pipeline, 1) == 0);
+    if (!pipelined)
+    {
+        ESP_LOGE(TAG, "no display pipeline, frames are shown by the display task");
+    }
     xTaskCreate(&hello_task, "hello_task", 2048, NULL, 5, NULL);
-    xTaskCreate(&display_task, "display_task", 2048, NULL, 5, NULL);
+    xTaskCreatePinnedToCore(&display_task, "display_task", RENDER_TASK_STACK, NULL, 5, NULL, 0);
 }
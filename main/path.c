@@ -0,0 +1,244 @@
+
+#include <stdlib.h>
+#include "path.h"
+#include "fixmath.h"
+
+#define max(a, b) ((a) > (b)? (a) : (b))
+
+// sub-pixel bits of the coordinates curves are flattened in
+#define FRAC 4
+#define ONE (1 << FRAC)
+
+// the most a flattened curve may stray from the true one, 1/4 pixel
+#define TOLERANCE (ONE / 4)
+
+// segments per curve piece, longer curves are split in halves first
+#define MAX_SEGMENTS 64
+
+void path_init(path_t* p, point_t* pts, int max_pts, int16_t* counts, int max_contours)
+{
+    p->pts = pts;
+    p->counts = counts;
+    p->max_pts = max_pts;
+    p->max_contours = max_contours;
+    path_transform(p, 0, 0, 256);
+    path_reset(p);
+}
+
+void path_reset(path_t* p)
+{
+    p->npts = 0;
+    p->ncontours = 0;
+    p->x = 0;
+    p->y = 0;
+    p->overflow = 0;
+}
+
+void path_transform(path_t* p, int ox, int oy, int scale)
+{
+    p->ox = ox;
+    p->oy = oy;
+    p->scale = scale;
+}
+
+static int32_t map_x(const path_t* p, int x)
+{
+    return (p->ox << FRAC) + ((x * p->scale) >> (8 - FRAC));
+}
+
+static int32_t map_y(const path_t* p, int y)
+{
+    return (p->oy << FRAC) + ((y * p->scale) >> (8 - FRAC));
+}
+
+static void begin_contour(path_t* p)
+{
+    if (p->ncontours == p->max_contours)
+    {
+        p->overflow = 1;
+        return;
+    }
+    p->counts[p->ncontours++] = 0;
+}
+
+/* appends the pixel nearest to (x, y), given in 1/16 pixels */
+static void emit(path_t* p, int32_t x, int32_t y)
+{
+    if (p->ncontours == 0)
+    {
+        begin_contour(p);
+        if (p->ncontours == 0) return;
+    }
+    point_t pt = { (x + ONE / 2) >> FRAC, (y + ONE / 2) >> FRAC };
+    int16_t* count = &p->counts[p->ncontours - 1];
+    if (*count > 0)
+    {
+        const point_t* last = &p->pts[p->npts - 1];
+        if (last->x == pt.x && last->y == pt.y)
+        {
+            return;
+        }
+    }
+    if (p->npts == p->max_pts)
+    {
+        p->overflow = 1;
+        return;
+    }
+    p->pts[p->npts++] = pt;
+    ++*count;
+}
+
+void path_move_to(path_t* p, int x, int y)
+{
+    p->x = map_x(p, x);
+    p->y = map_y(p, y);
+    if (p->ncontours > 0 && p->counts[p->ncontours - 1] <= 1)
+    {
+        // a contour that is just a starting point is replaced
+        p->npts -= p->counts[p->ncontours - 1];
+        p->counts[p->ncontours - 1] = 0;
+    }
+    else
+    {
+        begin_contour(p);
+    }
+    emit(p, p->x, p->y);
+}
+
+void path_line_to(path_t* p, int x, int y)
+{
+    p->x = map_x(p, x);
+    p->y = map_y(p, y);
+    emit(p, p->x, p->y);
+}
+
+/*
+ * Number of chords that keep a curve within TOLERANCE. dd is a bound on the
+ * second differences of its control polygon, the chords of n equal steps
+ * deviate by at most k * dd / n^2.
+ */
+static int segments(uint32_t dd, int k)
+{
+    return isqrt((uint64_t)k * (dd / (4 * TOLERANCE)) + 1) + 1;
+}
+
+static int64_t div_round(int64_t num, int64_t den)
+{
+    return (num >= 0)? (num + den / 2) / den : -((-num + den / 2) / den);
+}
+
+/* the curve from (px[0], py[0]), whose first point has been emitted */
+static void quad(path_t* p, const int32_t* px, const int32_t* py)
+{
+    uint32_t dd = abs(px[0] - 2 * px[1] + px[2]) + abs(py[0] - 2 * py[1] + py[2]);
+    int n = segments(dd, 1);
+    if (n > MAX_SEGMENTS)
+    {
+        // de Casteljau at t = 1/2, each half needs half the chords
+        int32_t ax[3] = { px[0], (px[0] + px[1]) / 2, (px[0] + 2 * px[1] + px[2]) / 4 };
+        int32_t ay[3] = { py[0], (py[0] + py[1]) / 2, (py[0] + 2 * py[1] + py[2]) / 4 };
+        int32_t bx[3] = { ax[2], (px[1] + px[2]) / 2, px[2] };
+        int32_t by[3] = { ay[2], (py[1] + py[2]) / 2, py[2] };
+        quad(p, ax, ay);
+        quad(p, bx, by);
+        return;
+    }
+
+    // evaluated exactly at t = i / n, nothing accumulates
+    int64_t n2 = (int64_t)n * n;
+    for(int i = 1; i < n; ++i)
+    {
+        int64_t a = (int64_t)(n - i) * (n - i), b = 2 * (int64_t)i * (n - i), c = (int64_t)i * i;
+        emit(p, div_round(a * px[0] + b * px[1] + c * px[2], n2),
+                div_round(a * py[0] + b * py[1] + c * py[2], n2));
+    }
+    emit(p, px[2], py[2]);
+}
+
+void path_quad_to(path_t* p, int x1, int y1, int x, int y)
+{
+    int32_t px[3] = { p->x, map_x(p, x1), map_x(p, x) };
+    int32_t py[3] = { p->y, map_y(p, y1), map_y(p, y) };
+    quad(p, px, py);
+    p->x = px[2];
+    p->y = py[2];
+}
+
+static void cubic(path_t* p, const int32_t* px, const int32_t* py)
+{
+    uint32_t dd = max(abs(px[0] - 2 * px[1] + px[2]) + abs(py[0] - 2 * py[1] + py[2]),
+                      abs(px[1] - 2 * px[2] + px[3]) + abs(py[1] - 2 * py[2] + py[3]));
+    int n = segments(dd, 3);
+    if (n > MAX_SEGMENTS)
+    {
+        int32_t mx = (px[0] + 3 * px[1] + 3 * px[2] + px[3]) / 8;
+        int32_t my = (py[0] + 3 * py[1] + 3 * py[2] + py[3]) / 8;
+        int32_t ax[4] = { px[0], (px[0] + px[1]) / 2, (px[0] + 2 * px[1] + px[2]) / 4, mx };
+        int32_t ay[4] = { py[0], (py[0] + py[1]) / 2, (py[0] + 2 * py[1] + py[2]) / 4, my };
+        int32_t bx[4] = { mx, (px[1] + 2 * px[2] + px[3]) / 4, (px[2] + px[3]) / 2, px[3] };
+        int32_t by[4] = { my, (py[1] + 2 * py[2] + py[3]) / 4, (py[2] + py[3]) / 2, py[3] };
+        cubic(p, ax, ay);
+        cubic(p, bx, by);
+        return;
+    }
+
+    int64_t n3 = (int64_t)n * n * n;
+    for(int i = 1; i < n; ++i)
+    {
+        int64_t u = n - i;
+        int64_t a = u * u * u, b = 3 * u * u * i, c = 3 * u * i * i, d = (int64_t)i * i * i;
+        emit(p, div_round(a * px[0] + b * px[1] + c * px[2] + d * px[3], n3),
+                div_round(a * py[0] + b * py[1] + c * py[2] + d * py[3], n3));
+    }
+    emit(p, px[3], py[3]);
+}
+
+void path_cubic_to(path_t* p, int x1, int y1, int x2, int y2, int x, int y)
+{
+    int32_t px[4] = { p->x, map_x(p, x1), map_x(p, x2), map_x(p, x) };
+    int32_t py[4] = { p->y, map_y(p, y1), map_y(p, y2), map_y(p, y) };
+    cubic(p, px, py);
+    p->x = px[3];
+    p->y = py[3];
+}
+
+void path_close(path_t* p)
+{
+    if (p->ncontours == 0 || p->counts[p->ncontours - 1] < 2)
+    {
+        return;
+    }
+    // the repeated first point marks the contour as closed for stroking,
+    // filling ignores the empty edge
+    const point_t* first = &p->pts[p->npts - p->counts[p->ncontours - 1]];
+    p->x = first->x << FRAC;
+    p->y = first->y << FRAC;
+    emit(p, p->x, p->y);
+
+    // drawing on continues in a new contour from the same point
+    begin_contour(p);
+    emit(p, p->x, p->y);
+}
+
+void path_fill(surface_t* s, const path_t* p, fill_rule_t rule, int color)
+{
+    if (p->ncontours > 0)
+    {
+        draw_filled_polygons(s, p->pts, p->counts, p->ncontours, rule, color);
+    }
+}
+
+void path_stroke(surface_t* s, const path_t* p, const stroke_t* style, int color)
+{
+    const point_t* pt = p->pts;
+    for(int c = 0; c < p->ncontours; ++c)
+    {
+        int n = p->counts[c];
+        int closed = n > 2 && pt[0].x == pt[n - 1].x && pt[0].y == pt[n - 1].y;
+        if (n > 1)
+        {
+            draw_polyline(s, pt, closed? n - 1 : n, closed, style, color);
+        }
+        pt += n;
+    }
+}
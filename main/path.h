@@ -0,0 +1,69 @@
+/*
+ * Vector paths. Straight segments and quadratic or cubic Bézier curves are
+ * flattened into polygons as they are added, with chords that stay within
+ * 1/4 pixel of the curve however large it is, and the result can then be
+ * filled or stroked on any surface. An optional scale and offset lets the
+ * same path description be drawn at any size, e.g. icons designed on a grid.
+ */
+
+/* inclusion guard */
+#ifndef __PATH_H__
+#define __PATH_H__
+
+#include <stdint.h>
+
+#include "epaper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /*
+     * A path under construction. The flattened points and the per-contour
+     * point counts go into caller-supplied arrays, adding to a path never
+     * allocates. Points that do not fit are dropped and overflow is set.
+     */
+    typedef struct
+    {
+        point_t* pts;
+        int16_t* counts;
+        int max_pts;
+        int max_contours;
+        int npts;
+        int ncontours;
+        int32_t x, y;           // current point in 1/16 pixels
+        int32_t ox, oy;         // pixel = o + v * scale / 256
+        int32_t scale;
+        int overflow;
+    } path_t;
+
+    extern void path_init(path_t* p, point_t* pts, int max_pts, int16_t* counts, int max_contours);
+
+    /* forgets all contours, the transform is kept */
+    extern void path_reset(path_t* p);
+
+    /* maps the coordinates of everything added afterwards: ox + v * scale / 256 */
+    extern void path_transform(path_t* p, int ox, int oy, int scale);
+
+    extern void path_move_to(path_t* p, int x, int y);
+    extern void path_line_to(path_t* p, int x, int y);
+
+    /* quadratic Bézier from the current point, control point (x1, y1) */
+    extern void path_quad_to(path_t* p, int x1, int y1, int x, int y);
+
+    /* cubic Bézier from the current point, control points (x1, y1) and (x2, y2) */
+    extern void path_cubic_to(path_t* p, int x1, int y1, int x2, int y2, int x, int y);
+
+    /* ends the contour with a segment back to its first point */
+    extern void path_close(path_t* p);
+
+    extern void path_fill(surface_t* s, const path_t* p, fill_rule_t rule, int color);
+
+    /* draws every contour as a polyline, closed ones with a join where they meet */
+    extern void path_stroke(surface_t* s, const path_t* p, const stroke_t* style, int color);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PATH_H__ */
@@ -0,0 +1,146 @@
+
+#include "region.h"
+
+#define min(a, b) ((a) < (b)? (a) : (b))
+#define max(a, b) ((a) > (b)? (a) : (b))
+
+static int32_t area(const rect_t* r)
+{
+    return (int32_t)(r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static void unite(rect_t* dst, const rect_t* a, const rect_t* b)
+{
+    dst->x0 = min(a->x0, b->x0);
+    dst->y0 = min(a->y0, b->y0);
+    dst->x1 = max(a->x1, b->x1);
+    dst->y1 = max(a->y1, b->y1);
+}
+
+static int contains(const rect_t* outer, const rect_t* inner)
+{
+    return outer->x0 <= inner->x0 && outer->y0 <= inner->y0 &&
+           outer->x1 >= inner->x1 && outer->y1 >= inner->y1;
+}
+
+/*
+ * Merge cost: pixels the union would cover that neither rectangle does. The
+ * overlap is added back so that overlapping rectangles are not charged twice.
+ */
+static int32_t merge_cost(const rect_t* a, const rect_t* b)
+{
+    rect_t u;
+    unite(&u, a, b);
+    int32_t cost = area(&u) - area(a) - area(b);
+
+    int32_t w = min(a->x1, b->x1) - max(a->x0, b->x0);
+    int32_t h = min(a->y1, b->y1) - max(a->y0, b->y0);
+    if (w > 0 && h > 0)
+    {
+        cost += w * h;
+    }
+    return cost;
+}
+
+/* a merge is free as long as it wastes at most a quarter of the covered area */
+static int cheap_merge(const rect_t* a, const rect_t* b)
+{
+    return 4 * merge_cost(a, b) <= area(a) + area(b);
+}
+
+static void remove_rect(region_t* r, int i)
+{
+    r->rects[i] = r->rects[--r->count];
+}
+
+void region_clear(region_t* r)
+{
+    r->count = 0;
+}
+
+void region_add(region_t* r, const rect_t* rect)
+{
+    if (rect->x0 >= rect->x1 || rect->y0 >= rect->y1)
+    {
+        return;
+    }
+
+    rect_t add = *rect;
+    for(int i = 0; i < r->count; ++i)
+    {
+        if (contains(&r->rects[i], &add))
+        {
+            return;
+        }
+    }
+
+    // fold in every rectangle that merges cheaply, the union may enable more
+    for(int i = 0; i < r->count; )
+    {
+        if (cheap_merge(&r->rects[i], &add))
+        {
+            unite(&add, &add, &r->rects[i]);
+            remove_rect(r, i);
+            i = 0;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    if (r->count == REGION_MAX_RECTS)
+    {
+        // full, merge the cheapest pair among the stored rectangles and the new one
+        int best_i = 0, best_j = -1;
+        int32_t best = merge_cost(&r->rects[0], &add);
+        for(int i = 0; i < r->count; ++i)
+        {
+            int32_t cost = merge_cost(&r->rects[i], &add);
+            if (cost < best)
+            {
+                best = cost;
+                best_i = i;
+                best_j = -1;
+            }
+            for(int j = i + 1; j < r->count; ++j)
+            {
+                cost = merge_cost(&r->rects[i], &r->rects[j]);
+                if (cost < best)
+                {
+                    best = cost;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+
+        if (best_j < 0)
+        {
+            unite(&add, &add, &r->rects[best_i]);
+            remove_rect(r, best_i);
+        }
+        else
+        {
+            unite(&r->rects[best_i], &r->rects[best_i], &r->rects[best_j]);
+            remove_rect(r, best_j);
+        }
+    }
+
+    r->rects[r->count++] = add;
+}
+
+int region_bounds(const region_t* r, rect_t* bounds)
+{
+    if (r->count == 0)
+    {
+        return 0;
+    }
+
+    *bounds = r->rects[0];
+    for(int i = 1; i < r->count; ++i)
+    {
+        unite(bounds, bounds, &r->rects[i]);
+    }
+    return 1;
+}
@@ -0,0 +1,55 @@
+/*
+ * Small fixed-size sets of rectangles, used to track which parts of a surface
+ * have been modified since the panel was last updated.
+ */
+
+/* inclusion guard */
+#ifndef __REGION_H__
+#define __REGION_H__
+
+#include <stdint.h>
+
+#define REGION_MAX_RECTS 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /* half-open rectangle, covers x0 <= x < x1 and y0 <= y < y1 */
+    typedef struct
+    {
+        int16_t x0;
+        int16_t y0;
+        int16_t x1;
+        int16_t y1;
+    } rect_t;
+
+    typedef struct
+    {
+        int count;
+        rect_t rects[REGION_MAX_RECTS];
+    } region_t;
+
+    extern void region_clear(region_t* r);
+
+    /*
+     * Adds a rectangle to the region. Rectangles that can be merged without
+     * covering too many untouched pixels are merged right away; once the set
+     * is full the pair that wastes the least area is merged to make room.
+     * The rectangles of a region may overlap.
+     */
+    extern void region_add(region_t* r, const rect_t* rect);
+
+    /* bounding box of all rectangles, returns 0 for an empty region */
+    extern int region_bounds(const region_t* r, rect_t* bounds);
+
+    static inline int region_empty(const region_t* r)
+    {
+        return r->count == 0;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __REGION_H__ */
@@ -0,0 +1,204 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "render.h"
+
+typedef struct
+{
+    surface_t* target;
+    render_fn draw;
+    void* ctx;
+    int band_rows;
+    int next;           // first row of the next unclaimed band
+    region_t dirty;     // what the helper has drawn
+} parallel_job_t;
+
+static parallel_job_t job;
+static SemaphoreHandle_t job_ready;
+static SemaphoreHandle_t job_done;
+static TaskHandle_t helper;
+
+void render_banded(render_fn draw, void* ctx, uint8_t* band, int band_rows)
+{
+    surface_t s;
+    for(int plane = 1; plane <= 2; ++plane)
+    {
+        epd_stream_begin(plane);
+        for(int y = 0; y < EPD_HEIGHT; y += band_rows)
+        {
+            int rows = (y + band_rows > EPD_HEIGHT)? EPD_HEIGHT - y : band_rows;
+            surface_init_band(&s, band, EPD_WIDTH, y, rows);
+            clear(&s, 1);
+            draw(&s, ctx);
+            epd_stream_write(band, rows * EPD_BYTES_PER_ROW);
+        }
+    }
+    epd_stream_end();
+}
+
+static void render_bands(parallel_job_t* j, region_t* dirty)
+{
+    surface_t* t = j->target;
+    surface_t band;
+    for(;;)
+    {
+        int y = __atomic_fetch_add(&j->next, j->band_rows, __ATOMIC_RELAXED);
+        if (y >= t->clip.y1)
+        {
+            break;
+        }
+        int rows = (y + j->band_rows > t->clip.y1)? t->clip.y1 - y : j->band_rows;
+
+        // a view of the band's rows, bands never share a byte
+        surface_init_band(&band, t->bits + (y - t->org_y) * t->stride, t->width, y, rows);
+        band.stride = t->stride;
+        band.org_x = t->org_x;
+        band.clip.x0 = t->clip.x0;
+        band.clip.x1 = t->clip.x1;
+        j->draw(&band, j->ctx);
+
+        for(int i = 0; i < band.dirty.count; ++i)
+        {
+            region_add(dirty, &band.dirty.rects[i]);
+        }
+    }
+}
+
+static void helper_task(void* pvParameter)
+{
+    while(1) {
+        xSemaphoreTake(job_ready, portMAX_DELAY);
+        render_bands(&job, &job.dirty);
+        xSemaphoreGive(job_done);
+    }
+}
+
+static int start_helper(void)
+{
+    if (helper)
+    {
+        return 1;
+    }
+    if (!job_ready) job_ready = xSemaphoreCreateBinary();
+    if (!job_done) job_done = xSemaphoreCreateBinary();
+    if (!job_ready || !job_done)
+    {
+        return 0;
+    }
+    int core = xPortGetCoreID()? 0 : 1;
+    return xTaskCreatePinnedToCore(&helper_task, "render_helper", RENDER_TASK_STACK, NULL, 5, &helper, core) == pdPASS;
+}
+
+void render_parallel(surface_t* s, render_fn draw, void* ctx, int band_rows)
+{
+    // bands are rows of the bits, only an unrotated surface's rows are those of the drawing
+    if (s->list || s->orientation != ROTATE_0 || band_rows <= 0 || !start_helper())
+    {
+        draw(s, ctx);
+        return;
+    }
+
+    job.target = s;
+    job.draw = draw;
+    job.ctx = ctx;
+    job.band_rows = band_rows;
+    job.next = s->clip.y0;
+    region_clear(&job.dirty);
+    xSemaphoreGive(job_ready);
+
+    region_t dirty;
+    region_clear(&dirty);
+    render_bands(&job, &dirty);
+
+    // barrier: the frame is not complete before the helper's last band is
+    xSemaphoreTake(job_done, portMAX_DELAY);
+
+    for(int i = 0; i < dirty.count; ++i)
+    {
+        region_add(&s->dirty, &dirty.rects[i]);
+    }
+    for(int i = 0; i < job.dirty.count; ++i)
+    {
+        region_add(&s->dirty, &job.dirty.rects[i]);
+    }
+}
+
+/* takes s, trying without blocking first so the common case costs no clock reads */
+static void take(SemaphoreHandle_t s, owner_stats_t* stats)
+{
+    if (xSemaphoreTake(s, 0) != pdTRUE)
+    {
+        int64_t start = esp_timer_get_time();
+        xSemaphoreTake(s, portMAX_DELAY);
+        uint32_t waited = (uint32_t)(esp_timer_get_time() - start);
+        ++stats->contended;
+        stats->wait_us += waited;
+        if (waited > stats->max_wait_us) stats->max_wait_us = waited;
+    }
+    ++stats->acquired;
+}
+
+static void scanout_task(void* pvParameter)
+{
+    pipeline_t* p = (pipeline_t*)pvParameter;
+    while(1) {
+        xSemaphoreTake(p->ready, portMAX_DELAY);
+        // waking the panel takes a reset and most of a second, not for a frame that is already shown
+        if (!epd_frame_unchanged(p->frames[p->front]))
+        {
+            epd_wakeup();
+            epd_display(p->frames[p->front]);
+            epd_sleep();
+        }
+        p->front ^= 1;
+        xSemaphoreGive(p->free);
+    }
+}
+
+int pipeline_init(pipeline_t* p, int core)
+{
+    memset(p, 0, sizeof(*p));
+    p->frames[0] = (uint8_t*)malloc(EPD_FRAME_BYTES);
+    p->frames[1] = (uint8_t*)malloc(EPD_FRAME_BYTES);
+    p->ready = xSemaphoreCreateCounting(2, 0);
+    p->free = xSemaphoreCreateCounting(2, 2);
+    if (!p->frames[0] || !p->frames[1] || !p->ready || !p->free
+        || xTaskCreatePinnedToCore(&scanout_task, "scanout_task", RENDER_TASK_STACK, p, 5, &p->scanout, core) != pdPASS)
+    {
+        free(p->frames[0]);
+        free(p->frames[1]);
+        if (p->ready) vSemaphoreDelete(p->ready);
+        if (p->free) vSemaphoreDelete(p->free);
+        memset(p, 0, sizeof(*p));
+        return -1;
+    }
+    return 0;
+}
+
+int pipeline_begin(pipeline_t* p, surface_t* s)
+{
+    if (p->drawing)
+    {
+        return -1;
+    }
+    take(p->free, &p->stats);
+    p->drawing = 1;
+    surface_init(s, p->frames[p->back], EPD_WIDTH, EPD_HEIGHT);
+    return 0;
+}
+
+int pipeline_present(pipeline_t* p, surface_t* s)
+{
+    if (!p->drawing || s->bits != p->frames[p->back])
+    {
+        return -1;
+    }
+    s->clip.x1 = s->clip.x0;
+    s->clip.y1 = s->clip.y0;
+    p->drawing = 0;
+    // frames are shown in the order they are presented, buffers simply alternate
+    p->back ^= 1;
+    xSemaphoreGive(p->ready);
+    return 0;
+}
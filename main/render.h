@@ -0,0 +1,109 @@
+/*
+ * Frame rendering strategies that sit between the drawing primitives and the
+ * panel driver.
+ */
+
+/* inclusion guard */
+#ifndef __RENDER_H__
+#define __RENDER_H__
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "epaper.h"
+
+/*
+ * Stack of the tasks that replay display lists. Flood fills, arcs, sprites
+ * and the polygon sort nest deep under the windowed ABI, 2048 bytes leave
+ * no margin.
+ */
+#define RENDER_TASK_STACK 4096
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /* draws a frame, or the part of it that falls into the surface's clip */
+    typedef void (*render_fn)(surface_t* s, void* ctx);
+
+    /*
+     * Renders a frame without a full framebuffer. band must hold band_rows
+     * rows of EPD_BYTES_PER_ROW bytes; the frame is cleared to white and drawn
+     * into it one band at a time, and every band is streamed to the (awake)
+     * panel as soon as it is done. Since the panel takes the image twice, draw
+     * is called twice per band, it must produce the same image every time.
+     * An even band_rows keeps the bands word aligned.
+     */
+    extern void render_banded(render_fn draw, void* ctx, uint8_t* band, int band_rows);
+
+    /*
+     * Renders into s on both cores. The rows of s's clip are cut into bands of
+     * band_rows rows that the calling task and a helper task pinned to the
+     * other core claim one after the other, so draw runs concurrently on
+     * disjoint bands of the same buffer and must only read shared state (a
+     * display list, for example). Returns once every band is finished, with
+     * everything drawn marked dirty in s. Only one task may use it at a time.
+     * Recording and rotated surfaces are drawn by the calling task alone.
+     */
+    extern void render_parallel(surface_t* s, render_fn draw, void* ctx, int band_rows);
+
+    /* how often the renderer had to wait for a frame, and how long */
+    typedef struct
+    {
+        uint32_t acquired;
+        uint32_t contended;
+        uint32_t wait_us;
+        uint32_t max_wait_us;
+    } owner_stats_t;
+
+    /*
+     * Double-buffered frame pipeline: a scanout task pinned to its own core
+     * pushes finished frames to the panel (wakeup, display, sleep) while the
+     * next one is rendered into the other buffer. A frame identical to the
+     * one on the panel leaves the panel asleep. The two frames belong to the
+     * pipeline, framebuffer and screen are not one of them; they are only
+     * drawn through the surface pipeline_begin() hands out.
+     */
+    typedef struct
+    {
+        uint8_t* frames[2];
+        int back;                   // frame handed out by pipeline_begin
+        int front;                  // frame the scanout task shows next
+        int drawing;                // the back frame is handed out
+        SemaphoreHandle_t ready;    // finished frames waiting for scanout
+        SemaphoreHandle_t free;     // frames the renderer may draw into
+        TaskHandle_t scanout;
+        owner_stats_t stats;        // pipeline_begin waiting for a free frame
+    } pipeline_t;
+
+    /*
+     * Sets up a pipeline over two EPD_FRAME_BYTES frames taken from the heap
+     * and starts its scanout task on the given core. Returns 0 on success, -1
+     * if the frames, the task or its semaphores could not be created.
+     */
+    extern int pipeline_init(pipeline_t* p, int core);
+
+    /*
+     * Makes s a landscape surface over the frame to render next, waiting
+     * while both are still queued for or being shown by the scanout task.
+     * The frame holds an old image, the whole frame must be redrawn. The
+     * caller owns it until pipeline_present(), the scanout task never reads
+     * it meanwhile. Returns -1, leaving s alone, if the last frame handed
+     * out has not been presented yet.
+     */
+    extern int pipeline_begin(pipeline_t* p, surface_t* s);
+
+    /*
+     * Hands the frame s was drawing into to the scanout task and empties s's
+     * clip, so nothing drawn through it afterwards reaches the frame. Returns
+     * -1 and presents nothing if s is not the surface from pipeline_begin().
+     */
+    extern int pipeline_present(pipeline_t* p, surface_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RENDER_H__ */
@@ -0,0 +1,251 @@
+
+#include <stdlib.h>
+#include "epaper.h"
+#include "fixmath.h"
+
+// the outline is worked out in 1/16 pixels, then rounded to pixel corners
+#define FRAC 4
+#define ONE (1 << FRAC)
+
+typedef struct
+{
+    int32_t x;
+    int32_t y;
+} vec_t;
+
+typedef struct
+{
+    point_t* pts;
+    int16_t* counts;
+    int npts;
+    int ncontours;
+} outline_t;
+
+static void begin(outline_t* o)
+{
+    o->counts[o->ncontours++] = 0;
+}
+
+static void add(outline_t* o, vec_t v)
+{
+    point_t p = { (v.x + ONE / 2) >> FRAC, (v.y + ONE / 2) >> FRAC };
+    o->pts[o->npts++] = p;
+    ++o->counts[o->ncontours - 1];
+}
+
+/* all contours run the same way round, so the non-zero rule unites them */
+static void end(outline_t* o)
+{
+    int n = o->counts[o->ncontours - 1];
+    point_t* p = o->pts + o->npts - n;
+    int64_t area = 0;
+    for(int i = 0, j = n - 1; i < n; j = i++)
+    {
+        area += (int64_t)p[j].x * p[i].y - (int64_t)p[i].x * p[j].y;
+    }
+    if (area < 0)
+    {
+        for(int i = 0, j = n - 1; i < j; ++i, --j)
+        {
+            point_t t = p[i]; p[i] = p[j]; p[j] = t;
+        }
+    }
+}
+
+static vec_t centre(point_t p)
+{
+    vec_t v = { p.x * ONE + ONE / 2, p.y * ONE + ONE / 2 };
+    return v;
+}
+
+static vec_t offset(vec_t v, vec_t d, int sign)
+{
+    vec_t r = { v.x + sign * d.x, v.y + sign * d.y };
+    return r;
+}
+
+static int32_t div_round(int64_t num, int64_t den)
+{
+    return (num >= 0)? (num + den / 2) / den : -((-num + den / 2) / den);
+}
+
+/* the direction from a to b, scaled to length h */
+static vec_t along(point_t a, point_t b, int32_t h)
+{
+    int32_t dx = b.x - a.x, dy = b.y - a.y;
+    int64_t len = isqrt(((int64_t)dx * dx + (int64_t)dy * dy) << (2 * FRAC));
+    vec_t t = { div_round((int64_t)dx * ONE * h, len), div_round((int64_t)dy * ONE * h, len) };
+    return t;
+}
+
+static vec_t normal(vec_t t)
+{
+    vec_t n = { -t.y, t.x };
+    return n;
+}
+
+static void add_disc(outline_t* o, vec_t c, int32_t r, int step)
+{
+    begin(o);
+    for(int a = 0; a < 360; a += step)
+    {
+        vec_t v = { c.x + div_round((int64_t)icos(a) * r, FIX_ONE), c.y + div_round((int64_t)isin(a) * r, FIX_ONE) };
+        add(o, v);
+    }
+    end(o);
+}
+
+/* fills the outside of the corner at v between the segments p-v and v-n */
+static void add_join(outline_t* o, point_t p, point_t v, point_t n, int32_t h, const stroke_t* style, int step)
+{
+    int64_t cross = (int64_t)(v.x - p.x) * (n.y - v.y) - (int64_t)(v.y - p.y) * (n.x - v.x);
+    int64_t dot = (int64_t)(v.x - p.x) * (n.x - v.x) + (int64_t)(v.y - p.y) * (n.y - v.y);
+    if (cross == 0 && dot > 0)
+    {
+        return;
+    }
+    vec_t c = centre(v);
+    if (style->join == JOIN_ROUND)
+    {
+        add_disc(o, c, h, step);
+        return;
+    }
+
+    // the outer side is the one facing away from the turn
+    int sign = (cross > 0)? -1 : 1;
+    vec_t n1 = normal(along(p, v, h));
+    vec_t n2 = normal(along(v, n, h));
+    begin(o);
+    add(o, c);
+    add(o, offset(c, n1, sign));
+    if (style->join == JOIN_MITER)
+    {
+        // the miter tip is (n1 + n2) * h^2 / (h^2 + n1.n2) from the corner
+        int64_t hh = (int64_t)h * h;
+        int64_t den = hh + (int64_t)n1.x * n2.x + (int64_t)n1.y * n2.y;
+        int64_t limit = style->miter_limit? style->miter_limit : 4;
+        if (den > 0)
+        {
+            vec_t m = { div_round((n1.x + n2.x) * hh, den), div_round((n1.y + n2.y) * hh, den) };
+            if ((int64_t)m.x * m.x + (int64_t)m.y * m.y <= limit * limit * hh)
+            {
+                add(o, offset(c, m, sign));
+            }
+        }
+    }
+    add(o, offset(c, n2, sign));
+    end(o);
+}
+
+void draw_polyline(surface_t* s, const point_t* pts, int n, int closed, const stroke_t* style, int color)
+{
+    if (n <= 0)
+    {
+        return;
+    }
+    if (style == NULL || style->width <= 1)
+    {
+        for(int i = 1; i < n; ++i)
+        {
+            draw_line(s, pts[i - 1].x, pts[i - 1].y, pts[i].x, pts[i].y, color);
+        }
+        if (closed && n > 2)
+        {
+            draw_line(s, pts[n - 1].x, pts[n - 1].y, pts[0].x, pts[0].y, color);
+        }
+        if (n == 1)
+        {
+            set_pixel(s, pts[0].x, pts[0].y, color);
+        }
+        return;
+    }
+
+    int32_t h = style->width * ONE / 2;
+    int step = (style->width <= 4)? 45 : (style->width <= 12)? 30 : (style->width <= 40)? 15 : 5;
+    int disc = 360 / step;
+
+    // everything lives in one block: the points without repeats, then the outline
+    int max_pts = n + n * 4 + n * ((disc > 4)? disc : 4) + 2 * disc;
+    int max_contours = 2 * n + 2;
+    point_t* v = (point_t*)malloc(max_pts * sizeof(point_t) + max_contours * sizeof(int16_t));
+    if (v == NULL)
+    {
+        return;
+    }
+    int m = 0;
+    for(int i = 0; i < n; ++i)
+    {
+        if (m == 0 || pts[i].x != v[m - 1].x || pts[i].y != v[m - 1].y)
+        {
+            v[m++] = pts[i];
+        }
+    }
+    if (closed && m > 1 && v[0].x == v[m - 1].x && v[0].y == v[m - 1].y)
+    {
+        --m;
+    }
+    closed = closed && m > 2;
+
+    outline_t o = { v + m, (int16_t*)(v + max_pts), 0, 0 };
+
+    if (m == 1)
+    {
+        vec_t c = centre(v[0]);
+        if (style->cap == CAP_ROUND)
+        {
+            add_disc(&o, c, h, step);
+        }
+        else if (style->cap == CAP_SQUARE)
+        {
+            vec_t a = { h, h }, b = { h, -h };
+            begin(&o);
+            add(&o, offset(c, a, -1));
+            add(&o, offset(c, b, 1));
+            add(&o, offset(c, a, 1));
+            add(&o, offset(c, b, -1));
+            end(&o);
+        }
+    }
+
+    int nseg = closed? m : m - 1;
+    for(int i = 0; i < nseg; ++i)
+    {
+        point_t pa = v[i], pb = v[(i + 1) % m];
+        vec_t t = along(pa, pb, h);
+        vec_t nrm = normal(t);
+        vec_t a = centre(pa), b = centre(pb);
+        if (!closed && style->cap == CAP_SQUARE)
+        {
+            if (i == 0) a = offset(a, t, -1);
+            if (i == nseg - 1) b = offset(b, t, 1);
+        }
+        begin(&o);
+        add(&o, offset(a, nrm, 1));
+        add(&o, offset(b, nrm, 1));
+        add(&o, offset(b, nrm, -1));
+        add(&o, offset(a, nrm, -1));
+        end(&o);
+    }
+
+    for(int i = closed? 0 : 1; i < (closed? m : m - 1); ++i)
+    {
+        add_join(&o, v[(i + m - 1) % m], v[i], v[(i + 1) % m], h, style, step);
+    }
+    if (!closed && m > 1 && style->cap == CAP_ROUND)
+    {
+        add_disc(&o, centre(v[0]), h, step);
+        add_disc(&o, centre(v[m - 1]), h, step);
+    }
+
+    if (o.ncontours > 0)
+    {
+        draw_filled_polygons(s, o.pts, o.counts, o.ncontours, FILL_NONZERO, color);
+    }
+    free(v);
+}
+
+void draw_thick_line(surface_t* s, int x0, int y0, int x1, int y1, const stroke_t* style, int color)
+{
+    const point_t pts[] = { { x0, y0 }, { x1, y1 } };
+    draw_polyline(s, pts, 2, 0, style, color);
+}